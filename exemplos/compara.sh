@@ -0,0 +1,65 @@
+#!/bin/sh
+# Teste diferencial: cada exemplos/*.pas roda na maquina virtual (--executar) e
+# como executavel nativo (--asm + cc), em -O0, -O1 e -O2, com a mesma entrada
+# (X.in, se existir). Saida, mensagem de erro de execucao e codigo de retorno
+# tem de bater.
+#
+# uso: exemplos/compara.sh [compilador]   (sem argumento, compila main.cpp)
+set -u
+raiz=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+if [ $# -ge 1 ]; then
+    comp=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+else
+    comp=$tmp/compilador
+    ${CXX:-g++} -std=c++17 -O2 -pthread "$raiz/main.cpp" -o "$comp" || exit 1
+fi
+
+falhas=0
+total=0
+cd "$tmp"
+for prog in "$raiz"/exemplos/*.pas; do
+    nome=$(basename "$prog" .pas)
+    entrada=${prog%.pas}.in
+    [ -f "$entrada" ] || entrada=/dev/null
+    for o in 0 1 2; do
+        total=$((total + 1))
+        # o retorno do compilador reflete a execucao na VM; o que importa aqui e compilar
+        "$comp" "$prog" -O$o --sem-tabela --asm --executar < "$entrada" > vm.txt 2>&1
+        if ! grep -q "sem erros" vm.txt; then
+            echo "FALHA $nome -O$o: nao compilou"
+            falhas=$((falhas + 1))
+            continue
+        fi
+        if ! cc programa.s -o nativo 2> cc.txt; then
+            echo "FALHA $nome -O$o: cc"
+            head -5 cc.txt
+            falhas=$((falhas + 1))
+            continue
+        fi
+        ./nativo < "$entrada" > saida.txt 2> erro.txt
+        rc=$?
+
+        # A VM escreve a saida depois de "- Execucao -" e, se a execucao falha, a
+        # mensagem numa linha propria; o nativo manda a mensagem para stderr e sai com 1
+        sed -n '/^- Execucao -$/,$p' vm.txt | sed '1d' > esperado.txt
+        if grep -q "^Erro de execucao" esperado.txt; then
+            esperado_rc=1
+        else
+            esperado_rc=0
+        fi
+        { cat saida.txt; [ -s erro.txt ] && { echo; cat erro.txt; }; } > obtido.txt
+
+        if [ "$(cat esperado.txt)" != "$(cat obtido.txt)" ] || [ $rc -ne $esperado_rc ]; then
+            echo "FALHA $nome -O$o"
+            echo "  vm:     $(cat esperado.txt)"
+            echo "  nativo: $(cat obtido.txt) (retorno $rc)"
+            falhas=$((falhas + 1))
+        fi
+    done
+done
+
+echo "$((total - falhas))/$total comparacoes iguais"
+[ $falhas -eq 0 ]
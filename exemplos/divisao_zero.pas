@@ -0,0 +1,7 @@
+Program DivisaoZero;
+var a, z : integer;
+begin
+  read(a, z);
+  write("antes ");
+  write(a div z)
+end.
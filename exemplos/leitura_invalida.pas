@@ -0,0 +1,8 @@
+Program LeituraInvalida;
+var n, m : integer;
+begin
+  read(n);
+  write("lido ", n, " ");
+  read(m);
+  write("nao chega aqui ", m)
+end.
@@ -0,0 +1,18 @@
+Program Logica;
+var i, soma : integer;
+  par, achou : boolean;
+begin
+  i := 0;
+  soma := 0;
+  achou := false;
+  while (i < 100) and not achou do
+  begin
+    par := (i mod 2) = 0;
+    if par then
+      soma := soma + i
+    else if i > 90 then
+      achou := true;
+    i := i + 1
+  end;
+  write(soma, " ", i, " ", achou, " ", par or achou, " ", not (i <> 92))
+end.
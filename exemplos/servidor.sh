@@ -0,0 +1,44 @@
+#!/bin/sh
+# Ordem dos pedidos no --servidor: N pares verificarTexto (documento "d", texto
+# "Program p<i>; ...") seguido de tokens (documento "d"), com varias threads. Cada
+# 'tokens' tem de ver o texto do verificarTexto logo antes dele, nunca um anterior.
+#
+# uso: exemplos/servidor.sh [compilador] [pares]   (sem compilador, compila main.cpp)
+set -u
+raiz=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+if [ $# -ge 1 ]; then
+    comp=$1
+else
+    comp=$tmp/compilador
+    ${CXX:-g++} -std=c++17 -O2 -pthread "$raiz/main.cpp" -o "$comp" || exit 1
+fi
+pares=${2:-3000}
+
+awk -v n="$pares" 'BEGIN {
+    for (i = 0; i < n; i++) {
+        printf "{\"jsonrpc\": \"2.0\", \"id\": %d, \"method\": \"verificarTexto\", \"params\": {\"documento\": \"d\", \"texto\": \"Program p%d;\\nbegin\\nend.\"}}\n", 2 * i + 1, i
+        printf "{\"jsonrpc\": \"2.0\", \"id\": %d, \"method\": \"tokens\", \"params\": {\"documento\": \"d\"}}\n", 2 * i + 2
+    }
+    print "{\"jsonrpc\": \"2.0\", \"id\": 0, \"method\": \"encerrar\"}"
+}' > "$tmp/pedidos.txt"
+
+"$comp" --servidor -j 8 < "$tmp/pedidos.txt" > "$tmp/respostas.txt" || exit 1
+
+# A resposta de 'tokens' com id 2i+2 tem "p<i>" como segundo lexema
+awk -v n="$pares" '
+/"tokens": \[/ {
+    match($0, /"id": [0-9]+/)
+    id = substr($0, RSTART + 6, RLENGTH - 6) + 0
+    vistos++
+    if (index($0, "{\"lexema\": \"p" (id / 2 - 1) "\"") == 0) {
+        ruins++
+        if (ruins <= 3) print "FALHA id " id ": " substr($0, 1, 160)
+    }
+}
+END {
+    printf "%d de %d respostas de tokens na ordem\n", vistos - ruins, n
+    exit (vistos == n && ruins == 0) ? 0 : 1
+}' "$tmp/respostas.txt"
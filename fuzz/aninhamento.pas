@@ -0,0 +1,608 @@
+Program p;
+var x: integer;
+ b: boolean;
+begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+if (b) then begin
+x := ((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((1))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+end
+;
+write(x)
+end.
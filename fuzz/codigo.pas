@@ -0,0 +1,28 @@
+Program TesteIntermediario;
+
+var
+  contador : integer, (* Erro Sintático: Vírgula no final da declaração em vez de ponto e vírgula *)
+  limite : integer;
+  ativo : boolean;
+
+begin
+  limite := 100;
+  contador := 99;
+
+  (* Erro Sintático: 'if' sem a palavra-chave 'then' *)
+  if contador > limite
+    ativo := false
+  else
+    ativo := true;
+
+  (* Erro Semântico: A variável 'status' não foi declarada *)
+  status := "verificado";
+  
+  write("Contador: ", contador) (* Erro Sintático: Falta de ponto e vírgula para separar os comandos 'write' *)
+  write("Ativo: ", ativo);
+  
+  (* Erro Semântico: A condição do 'if' deve ser booleana, mas 'limite' é um inteiro *)
+  if limite then
+     write("O limite foi considerado verdadeiro.");
+  
+end.
\ No newline at end of file
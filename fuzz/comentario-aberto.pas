@@ -0,0 +1,6 @@
+Program P;
+var x : integer;
+begin
+  x := 1; (* comentario sem fim
+  write(x)
+end.
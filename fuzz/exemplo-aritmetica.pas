@@ -0,0 +1,16 @@
+Program Aritmetica;
+var a, b, c, i : integer;
+begin
+  a := 17;
+  b := 0 - 5;
+  write(a div b, " ", a mod b, " ", b div 2, " ", b mod 2, " ");
+  c := 1;
+  i := 0;
+  while i < 62 do
+  begin
+    c := c * 2;
+    i := i + 1
+  end;
+  write(c, " ", c * 4, " ", (c - 1) + c, " ");
+  write(a * b - (a + b) * 3, " ", 0 - a)
+end.
@@ -0,0 +1,19 @@
+Program Leitura;
+var n, i, soma : integer;
+  x, total : double;
+  b : boolean;
+begin
+  read(n);
+  i := 0;
+  soma := 0;
+  total := 0.0;
+  while i < n do
+  begin
+    read(x);
+    total := total + x;
+    soma := soma + i;
+    i := i + 1
+  end;
+  read(b);
+  write(soma, " ", total, " ", b)
+end.
@@ -0,0 +1,13 @@
+Program Reais;
+var x, y : double;
+  n : integer;
+begin
+  x := 1.0;
+  y := 3.0;
+  write(x / y, " ", 0.1 + 0.2, " ", 2.5 * 4.0, " ");
+  n := 7;
+  write(n / 2, " ", n * 1.5, " ", 100000000000.0 * 100000000000.0, " ");
+  x := 0.0;
+  write(y / x, " ", (0.0 - y) / x, " ", x / x, " ");
+  write(x = 0.0, " ", y > 2.5, " ", 1.0 / 1024.0)
+end.
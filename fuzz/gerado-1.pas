@@ -0,0 +1,16 @@
+Program Gerado2;
+
+var
+  i0, i1, i2, i3, i4, i5, i6, i7 : integer;
+  i8, i9, i10 : integer;
+  d0, d1, d2, d3, d4, d5, d6, d7 : double;
+  d8, d9, d10 : double;
+  b0, b1, b2, b3, b4, b5, b6, b7 : boolean;
+  b8, b9 : boolean;
+
+begin
+  begin
+    write((i2 - (i10 + i6)), "texto 445: ", not (i4 <> i10))
+  end;
+  write("fim")
+end.
@@ -0,0 +1,25 @@
+Program Gerado13;
+
+var
+  i0, i1, i2, i3, i4, i5, i6, i7 : integer;
+  i8, i9, i10 : integer;
+  d0, d1, d2, d3, d4, d5, d6, d7 : double;
+  d8, d9, d10 : double;
+  b0, b1, b2, b3, b4, b5, b6, b7 : boolean;
+  b8, b9 : boolean;
+
+begin
+  d10 := (d3 - (2.88 + i1));
+  read(i7, d10);
+  if (i6 >= (989 mod 293)) then
+    if not (b0 or true) then
+      d0 := ((969.41 - 257.49) * (269.84 * d1))
+    else
+      b3 := not not b5;
+  write((421 mod i10));
+  if not (b9 or b2) then
+    (* comentario 87823 *)
+    b6 := b1;
+  write((592 div 111));
+  write("fim")
+end.
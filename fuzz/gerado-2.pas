@@ -0,0 +1,24 @@
+Program Gerado3;
+
+var
+  i0, i1, i2, i3, i4, i5, i6, i7 : integer;
+  i8, i9, i10 : integer;
+  d0, d1, d2, d3, d4, d5, d6, d7 : double;
+  d8, d9, d10 : double;
+  b0, b1, b2, b3, b4, b5, b6, b7 : boolean;
+  b8, b9 : boolean;
+
+begin
+  i0 := 1 $ 2;
+  while (((378 + i8) div ((i6 + i9) div (209 * 79))) < ((i1 * (648 mod 337)) div 943)) do
+    begin
+      read(i0);
+      begin
+        if not (not b3 and b4) then
+          write(i8)
+      end;
+      (* comentario 20930 *)
+      write((881.2 + (121.62 + (862.22 + d10))), d6, "texto 362: ")
+    end;
+  write("fim")
+end.
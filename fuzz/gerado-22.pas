@@ -0,0 +1,23 @@
+Program Gerado23;
+
+var
+  i0, i1, i2, i3, i4, i5, i6, i7 : integer;
+  i8, i9, i10 : integer;
+  d0, d1, d2, d3, d4, d5, d6, d7 : double;
+  d8, d9, d10 : double;
+  b0, b1, b2, b3, b4, b5, b6, b7 : boolean;
+  b8, b9 : boolean;
+
+begin
+  while not not b5 do
+    write((((i3 * 403) * (126 - i7)) div (i6 * 832)));
+  if (not b0 and true) then
+    d6 := ((d7 + (i0 * i4)) - (((i4 mod i8) * (418 mod 856)) mod (i4 - (960 mod i2))));
+  b9 := b3;
+  while b9 do
+    b0 := not false;
+  i3 := (i1 - i6);
+  if true then
+    write((d3 + ((d0 + 625.48) * (670.4 - 226))), (((i0 + i2) mod 436) mod ((i10 mod i7) + (297 + i2))));
+  write("fim")
+end.
@@ -0,0 +1,39 @@
+Program Gerado4;
+
+var
+  i0, i1, i2, i3, i4, i5, i6, i7 : integer;
+  i8, i9, i10 : integer;
+  d0, d1, d2, d3, d4, d5, d6, d7 : double;
+  d8, d9, d10 : double;
+  b0, b1, b2, b3, b4, b5, b6, b7 : boolean;
+  b8, b9 : boolean;
+
+begin
+  begin
+    i9 := 194;
+    if not ((i4 * 973) <> (630 mod i2)) then
+      if (false and b0) then
+        while (not (not not b3 or (b9 and true)) or b8) do
+          { comentario de uma linha }
+          d0 := 766.20
+    else
+      if b7 then
+        while ((((592 - (i10 mod i5)) + i6) * 787) > 804) do
+          write(d4, (942 * (((505 + i2) mod 295) + i8)));
+    while (true and not b3) do
+      { comentario de uma linha }
+      if not not (((117.27 * i10) - (d5 / d4)) >= d10) then
+        while false do
+          { comentario de uma linha }
+          while not b8 do
+            b1 := not (b9 or b1)
+      else
+        write(((835 * 835) + 463), (i0 - (i8 mod ((39 div 697) - (446 mod 559)))))
+  end;
+  b8 := ((438 > (352 div i4)) or true);
+  i8 = 1;
+  read(i3, d2);
+  { comentario de uma linha }
+  i7 := 1 $ 2;
+  write("fim")
+end.
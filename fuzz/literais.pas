@@ -0,0 +1,10 @@
+Program P;
+var x : integer;
+  d : double;
+begin
+  x := 99999999999999999999;
+  x := 9223372036854775807;
+  d := 1.5e;
+  d := 0.000000000000000000000000000001;
+  write(x, d)
+end.
@@ -0,0 +1,6 @@
+Program P;
+var s : string;
+begin
+  s := "texto sem fim;
+  write(s)
+end.
@@ -1,658 +1,6780 @@
 #include <iostream>
 #include <fstream>
-#include <regex>
 #include <vector>
 #include <iomanip>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cerrno>
+#include <cctype>
+#include <functional>
 #include <string>
 #include <sstream> // pegar varios tipos em uma unica string
+#include <string_view>
 #include <unordered_set>
 #include <unordered_map>
+#include <memory>
+#include <type_traits>
+#include <deque>
+#include <limits>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <random>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+enum TipoToken : uint8_t {
+    TK_PALAVRA_RESERVADA, TK_IDENTIFICADOR, TK_NUM_INTEIRO, TK_NUM_REAL, TK_STRING,
+    TK_SIMBOLO, TK_SIMBOLO_COMPOSTO, TK_ERRO_LEXICO, TK_EOF
+};
+
+// Nomes impressos na tabela de simbolos e nas mensagens de erro
+constexpr const char* nomeTipoToken[] = {
+    "Palavra reservada", "Identificador", "Numero inteiro", "Numero real", "String literal",
+    "simbolo", "simbolo_composto", "erro_lexico", "EOF"
+};
+
+// Subtipo de palavras reservadas e simbolos; o parser decide por ele, sem comparar texto
+enum Sub : uint8_t {
+    SUB_NENHUM,
+    PR_PROGRAM, PR_READ, PR_WRITE, PR_INTEGER, PR_BOOLEAN, PR_DOUBLE, PR_FUNCTION, PR_PROCEDURE, PR_BEGIN, PR_END,
+    PR_AND, PR_ARRAY, PR_CASE, PR_CONST, PR_DIV, PR_DO, PR_DOWNTO, PR_ELSE, PR_FILE, PR_FOR, PR_GOTO, PR_IF, PR_IN,
+    PR_LABEL, PR_MOD, PR_NIL, PR_NOT, PR_OF, PR_OR, PR_PACKED, PR_RECORD, PR_REPEAT, PR_SET, PR_THEN, PR_TO, PR_TYPE,
+    PR_UNTIL, PR_WITH, PR_VAR, PR_WHILE, PR_TRUE, PR_FALSE,
+    OP_ATRIB, OP_MENOR_IGUAL, OP_MAIOR_IGUAL, OP_DIFERENTE, OP_INCREMENTO, OP_DECREMENTO,
+    OP_MAIS, OP_MENOS, OP_VEZES, OP_BARRA, OP_IGUAL, OP_CIRCUNFLEXO, OP_MENOR, OP_MAIOR,
+    OP_PONTO_VIRGULA, OP_PONTO, OP_DOIS_PONTOS, OP_VIRGULA, OP_ABRE_PAR, OP_FECHA_PAR,
+    OP_ABRE_CHAVE, OP_FECHA_CHAVE, OP_ABRE_COLCHETE, OP_FECHA_COLCHETE,
+    NUM_SUB
+};
+
+constexpr const char* textoSub[NUM_SUB] = {
+    "",
+    "Program", "read", "write", "integer", "boolean", "double", "function", "procedure", "begin", "end",
+    "and", "array", "case", "const", "div", "do", "downto", "else", "file", "for", "goto", "if", "in",
+    "label", "mod", "nil", "not", "of", "or", "packed", "record", "repeat", "set", "then", "to", "type",
+    "until", "with", "var", "while", "true", "false",
+    ":=", "<=", ">=", "<>", "++", "--",
+    "+", "-", "*", "/", "=", "^", "<", ">",
+    ";", ".", ":", ",", "(", ")",
+    "{", "}", "[", "]"
+};
+
+constexpr uint32_t SEM_ID = UINT32_MAX;
+
+// Token compacto: o texto fica na Fonte e e achado pelo deslocamento
 struct Simbolo {
-    string lexema;
-    string tipo;
-    int linha;
+    uint64_t inicio;  // deslocamento do lexema na Fonte
+    uint64_t linha;
+    uint32_t tamanho;
+    uint32_t coluna;
+    uint32_t id;      // id do identificador no Internador (SEM_ID nos outros tokens)
+    TipoToken tipo;
+    Sub sub;          // palavra reservada ou simbolo (SUB_NENHUM nos outros tokens)
+};
+
+// Arquivo fonte inteiro na memoria: mapeado com mmap quando possivel, senao lido de uma vez
+class Fonte {
+    const char* dados = nullptr;
+    size_t tam = 0;
+    bool mapeado = false;
+    string buffer;
+    string reescritos; // lexemas que nao existem como tal no arquivo, enderecados depois de 'tam'
+
+public:
+    Fonte() = default;
+    Fonte(const Fonte&) = delete;
+    Fonte& operator=(const Fonte&) = delete;
+
+    ~Fonte() {
+#ifndef _WIN32
+        if (mapeado) munmap((void*)dados, tam);
+#endif
+    }
+
+    bool abrir(const string& arquivo) {
+#ifndef _WIN32
+        int fd = open(arquivo.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+                dados = (const char*)m;
+                tam = (size_t)st.st_size;
+                mapeado = true;
+                close(fd);
+                return true;
+            }
+        }
+        close(fd);
+#endif
+        ifstream arq(arquivo, ios::binary);
+        if (!arq.is_open()) return false;
+        buffer.assign(istreambuf_iterator<char>(arq), istreambuf_iterator<char>());
+        dados = buffer.data();
+        tam = buffer.size();
+        return true;
+    }
+
+    // Usa um texto ja na memoria (edicao incremental)
+    void carrega(string texto) {
+        buffer = move(texto);
+        dados = buffer.data();
+        tam = buffer.size();
+    }
+
+    string_view texto() const { return {dados, tam}; }
+
+    // Lexemas guardados, enderecados a partir de texto().size()
+    string_view guardados() const { return reescritos; }
+
+    // Guarda um lexema montado fora do arquivo e devolve o deslocamento dele
+    uint64_t guarda(string_view s) {
+        uint64_t pos = tam + reescritos.size();
+        reescritos.append(s);
+        return pos;
+    }
+
+    string_view lexema(uint64_t inicio, uint32_t tamanho) const {
+        if (inicio < tam) return {dados + inicio, tamanho};
+        return {reescritos.data() + (inicio - tam), tamanho};
+    }
+
+    string_view lexema(const Simbolo& s) const {
+        if (s.tipo == TK_EOF) return "EOF";
+        return lexema(s.inicio, s.tamanho);
+    }
+};
+
+// Da a cada identificador distinto um id denso (0, 1, 2, ...). Os nomes sao
+// views para a Fonte, que precisa viver tanto quanto o Internador; quando o
+// texto muda (edicao incremental), o Internador guarda copias dos nomes.
+class Internador {
+    unordered_map<string_view, uint32_t> ids;
+    vector<string_view> nomes;
+    bool guardaCopias = false;
+    deque<string> copias;
+
+public:
+    Internador() = default;
+    explicit Internador(bool guardaCopias) : guardaCopias(guardaCopias) {}
+
+    uint32_t id(string_view nome) {
+        auto it = ids.find(nome);
+        if (it != ids.end()) return it->second;
+        uint32_t novo = (uint32_t)nomes.size();
+        if (guardaCopias) {
+            copias.emplace_back(nome);
+            nome = copias.back();
+        }
+        ids.emplace(nome, novo);
+        nomes.push_back(nome);
+        return novo;
+    }
+
+    string_view nome(uint32_t id) const { return nomes[id]; }
+    size_t tamanho() const { return nomes.size(); }
+};
+
+// Hash perfeito das palavras reservadas (PR_PROGRAM..PR_FALSE), verificado em tempo de compilacao.
+// Usa tamanho, primeiro, segundo e ultimo caractere; todas tem de 2 a 9 letras.
+constexpr size_t TAM_HASH_PR = 128;
+
+constexpr size_t tamanhoPr(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+constexpr size_t hashPr(const char* s, size_t n) {
+    return (n * 4 + (unsigned char)s[0] * 18 + (unsigned char)s[1] * 14 + (unsigned char)s[n - 1]) % TAM_HASH_PR;
+}
+
+struct TabelaPr {
+    Sub palavra[TAM_HASH_PR] = {};
+    bool colisao = false;
+};
+
+constexpr TabelaPr montaTabelaPr() {
+    TabelaPr t;
+    for (int s = PR_PROGRAM; s <= PR_FALSE; s++) {
+        size_t h = hashPr(textoSub[s], tamanhoPr(textoSub[s]));
+        if (t.palavra[h] != SUB_NENHUM) t.colisao = true;
+        t.palavra[h] = (Sub)s;
+    }
+    return t;
+}
+
+constexpr TabelaPr tabelaPr = montaTabelaPr();
+static_assert(!tabelaPr.colisao, "hash das palavras reservadas nao e perfeito");
+
+// Devolve a palavra reservada correspondente, ou SUB_NENHUM
+Sub isPr(const char* s, size_t n) {
+    if (n < 2 || n > 9) return SUB_NENHUM;
+    Sub sub = tabelaPr.palavra[hashPr(s, n)];
+    if (sub == SUB_NENHUM) return SUB_NENHUM;
+    const char* p = textoSub[sub];
+    return strncmp(p, s, n) == 0 && p[n] == '\0' ? sub : SUB_NENHUM;
+}
+
+// Scanner: automato finito dirigido por tabela. Cada token e classificado
+// pelo estado de aceitacao em que o automato para (maior casamento).
+enum Classe : unsigned char {
+    CL_OUTRO, CL_ESPACO, CL_QUEBRA, CL_LETRA, CL_DIGITO, CL_PONTO, CL_ASPAS,
+    CL_MENOR, CL_MAIOR, CL_DOISPONTOS, CL_IGUAL, CL_MAIS, CL_MENOS, CL_SIMBOLO, CL_DOLAR,
+    NUM_CLASSES
+};
+
+enum Estado : unsigned char {
+    E_PARADA, E_INICIO, E_ID,
+    E_INT, E_INT_PONTO, E_REAL, E_REAL_PONTO, E_RUIM, E_PONTO, E_PONTO_DIG,
+    E_STR, E_STR_FIM,
+    E_MENOR, E_MENOR_IGUAL, E_DIFERENTE, E_MAIOR, E_MAIOR_IGUAL, E_DOISPONTOS, E_ATRIB,
+    E_MAIS, E_INCREMENTO, E_MENOS, E_DECREMENTO, E_SIMBOLO, E_DOLAR,
+    NUM_ESTADOS
+};
+
+enum Aceite : unsigned char {
+    A_NAO, A_ID, A_INT, A_REAL, A_RUIM, A_STR, A_SIMBOLO, A_COMPOSTO, A_DESCONHECIDO
+};
+
+struct TabelaScanner {
+    unsigned char classe[256] = {};
+    unsigned char prox[NUM_ESTADOS][NUM_CLASSES] = {};
+    unsigned char aceite[NUM_ESTADOS] = {};
+    unsigned char sub[NUM_ESTADOS] = {};   // simbolo reconhecido pelo estado
+    unsigned char subChar[256] = {};       // simbolo de um caractere so (estado E_SIMBOLO)
+};
+
+constexpr TabelaScanner montaScanner() {
+    TabelaScanner t;
+    for (int c = 'a'; c <= 'z'; c++) t.classe[c] = CL_LETRA;
+    for (int c = 'A'; c <= 'Z'; c++) t.classe[c] = CL_LETRA;
+    t.classe[(unsigned char)'_'] = CL_LETRA;
+    for (int c = '0'; c <= '9'; c++) t.classe[c] = CL_DIGITO;
+    t.classe[(unsigned char)' '] = t.classe[(unsigned char)'\t'] = CL_ESPACO;
+    t.classe[(unsigned char)'\v'] = t.classe[(unsigned char)'\f'] = CL_ESPACO;
+    t.classe[(unsigned char)'\r'] = t.classe[(unsigned char)'\n'] = CL_QUEBRA; // '.' do antigo regex nao casava com eles
+    t.classe[(unsigned char)'.'] = CL_PONTO;
+    t.classe[(unsigned char)'"'] = CL_ASPAS;
+    t.classe[(unsigned char)'<'] = CL_MENOR;
+    t.classe[(unsigned char)'>'] = CL_MAIOR;
+    t.classe[(unsigned char)':'] = CL_DOISPONTOS;
+    t.classe[(unsigned char)'='] = CL_IGUAL;
+    t.classe[(unsigned char)'+'] = CL_MAIS;
+    t.classe[(unsigned char)'-'] = CL_MENOS;
+    for (char c : "*/;,()[]{}^") if (c) t.classe[(unsigned char)c] = CL_SIMBOLO;
+    t.classe[(unsigned char)'$'] = CL_DOLAR;
+
+    t.prox[E_INICIO][CL_LETRA] = E_ID;
+    t.prox[E_INICIO][CL_DIGITO] = E_INT;
+    t.prox[E_INICIO][CL_PONTO] = E_PONTO;
+    t.prox[E_INICIO][CL_ASPAS] = E_STR;
+    t.prox[E_INICIO][CL_MENOR] = E_MENOR;
+    t.prox[E_INICIO][CL_MAIOR] = E_MAIOR;
+    t.prox[E_INICIO][CL_DOISPONTOS] = E_DOISPONTOS;
+    t.prox[E_INICIO][CL_IGUAL] = E_SIMBOLO;
+    t.prox[E_INICIO][CL_MAIS] = E_MAIS;
+    t.prox[E_INICIO][CL_MENOS] = E_MENOS;
+    t.prox[E_INICIO][CL_SIMBOLO] = E_SIMBOLO;
+    t.prox[E_INICIO][CL_DOLAR] = E_DOLAR;
+
+    t.prox[E_ID][CL_LETRA] = t.prox[E_ID][CL_DIGITO] = E_ID;
+
+    // numeros: d+ | d+.d+ | d*.d+.d* (invalido); "12." volta para o inteiro e ".5" para o ponto
+    t.prox[E_INT][CL_DIGITO] = E_INT;
+    t.prox[E_INT][CL_PONTO] = E_INT_PONTO;
+    t.prox[E_INT_PONTO][CL_DIGITO] = E_REAL;
+    t.prox[E_REAL][CL_DIGITO] = E_REAL;
+    t.prox[E_REAL][CL_PONTO] = E_REAL_PONTO;
+    t.prox[E_REAL_PONTO][CL_DIGITO] = E_RUIM;
+    t.prox[E_RUIM][CL_DIGITO] = E_RUIM;
+    t.prox[E_PONTO][CL_DIGITO] = E_PONTO_DIG;
+    t.prox[E_PONTO_DIG][CL_DIGITO] = E_PONTO_DIG;
+    t.prox[E_PONTO_DIG][CL_PONTO] = E_REAL_PONTO;
+
+    for (int c = 0; c < NUM_CLASSES; c++) t.prox[E_STR][c] = E_STR;
+    t.prox[E_STR][CL_QUEBRA] = E_PARADA;
+    t.prox[E_STR][CL_ASPAS] = E_STR_FIM;
+
+    t.prox[E_MENOR][CL_IGUAL] = E_MENOR_IGUAL;
+    t.prox[E_MENOR][CL_MAIOR] = E_DIFERENTE;
+    t.prox[E_MAIOR][CL_IGUAL] = E_MAIOR_IGUAL;
+    t.prox[E_DOISPONTOS][CL_IGUAL] = E_ATRIB;
+    t.prox[E_MAIS][CL_MAIS] = E_INCREMENTO;
+    t.prox[E_MENOS][CL_MENOS] = E_DECREMENTO;
+
+    t.aceite[E_ID] = A_ID;
+    t.aceite[E_INT] = A_INT;
+    t.aceite[E_REAL] = A_REAL;
+    t.aceite[E_REAL_PONTO] = t.aceite[E_RUIM] = A_RUIM;
+    t.aceite[E_STR_FIM] = A_STR;
+    t.aceite[E_PONTO] = t.aceite[E_MENOR] = t.aceite[E_MAIOR] = t.aceite[E_DOISPONTOS] = A_SIMBOLO;
+    t.aceite[E_MAIS] = t.aceite[E_MENOS] = t.aceite[E_SIMBOLO] = A_SIMBOLO;
+    t.aceite[E_MENOR_IGUAL] = t.aceite[E_DIFERENTE] = t.aceite[E_MAIOR_IGUAL] = A_COMPOSTO;
+    t.aceite[E_ATRIB] = t.aceite[E_INCREMENTO] = t.aceite[E_DECREMENTO] = A_COMPOSTO;
+    t.aceite[E_DOLAR] = A_DESCONHECIDO;
+
+    t.sub[E_PONTO] = OP_PONTO;
+    t.sub[E_MENOR] = OP_MENOR;
+    t.sub[E_MENOR_IGUAL] = OP_MENOR_IGUAL;
+    t.sub[E_DIFERENTE] = OP_DIFERENTE;
+    t.sub[E_MAIOR] = OP_MAIOR;
+    t.sub[E_MAIOR_IGUAL] = OP_MAIOR_IGUAL;
+    t.sub[E_DOISPONTOS] = OP_DOIS_PONTOS;
+    t.sub[E_ATRIB] = OP_ATRIB;
+    t.sub[E_MAIS] = OP_MAIS;
+    t.sub[E_INCREMENTO] = OP_INCREMENTO;
+    t.sub[E_MENOS] = OP_MENOS;
+    t.sub[E_DECREMENTO] = OP_DECREMENTO;
+    for (int s = OP_MAIS; s < NUM_SUB; s++) {
+        if (textoSub[s][1] == '\0') t.subChar[(unsigned char)textoSub[s][0]] = (unsigned char)s;
+    }
+    return t;
+}
+
+constexpr TabelaScanner scanner = montaScanner();
+
+// Varredura em bloco dos caminhos que so pulam texto: espacos, fim de comentario,
+// fim de string e contagem de quebras de linha. Cada primitiva tem uma versao
+// escalar, uma SSE2 e uma AVX2, escolhida em tempo de execucao pela CPU (ou por
+// --simd). Todas devolvem o indice encontrado, ou n se nao houver
+#if defined(__GNUC__) && defined(__x86_64__)
+#define VARREDURA_X86 1
+#else
+#define VARREDURA_X86 0
+#endif
+
+enum NivelSimd : uint8_t { SIMD_ESCALAR, SIMD_SSE2, SIMD_AVX2 };
+const char* const nomeSimd[] = {"escalar", "sse2", "avx2"};
+
+inline bool ehEspaco(char c) {
+    unsigned char u = (unsigned char)c;
+    return u == ' ' || (u >= '\t' && u <= '\r');
+}
+
+// Primeiro byte igual a a, b ou c
+size_t procuraEscalar(const char* p, size_t n, char a, char b, char c) {
+    size_t i = 0;
+    while (i < n && p[i] != a && p[i] != b && p[i] != c) i++;
+    return i;
+}
+
+// Primeiro i com p[i] == a e p[i + 1] == b
+size_t procuraParEscalar(const char* p, size_t n, char a, char b) {
+    for (size_t i = 0; i + 1 < n; i++) {
+        if (p[i] == a && p[i + 1] == b) return i;
+    }
+    return n;
+}
+
+// Primeiro byte que nao e espaco (' ', '\t', '\n', '\v', '\f', '\r')
+size_t pulaEspacosEscalar(const char* p, size_t n) {
+    size_t i = 0;
+    while (i < n && ehEspaco(p[i])) i++;
+    return i;
+}
+
+uint64_t contaByteEscalar(const char* p, size_t n, char c) {
+    return (uint64_t)count(p, p + n, c);
+}
+
+#if VARREDURA_X86
+// Cada bloco vira uma mascara de bits (um por byte); o primeiro achado e o bit mais baixo.
+// As versoes AVX2 terminam o resto com a SSE2, depois de limpar a metade alta dos
+// registradores (o GCC nao poe vzeroupper antes dessa chamada)
+size_t procuraSse2(const char* p, size_t n, char a, char b, char c) {
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)), _mm_cmpeq_epi8(v, vc));
+        if (unsigned bits = (unsigned)_mm_movemask_epi8(m)) return i + __builtin_ctz(bits);
+    }
+    return i + procuraEscalar(p + i, n - i, a, b, c);
+}
+
+size_t procuraParSse2(const char* p, size_t n, char a, char b) {
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 17 <= n; i += 16) {
+        __m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), va),
+                                  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + 1)), vb));
+        if (unsigned bits = (unsigned)_mm_movemask_epi8(m)) return i + __builtin_ctz(bits);
+    }
+    size_t k = procuraParEscalar(p + i, n - i, a, b);
+    return k == n - i ? n : i + k;
+}
+
+// Espaco e ' ' ou um byte de '\t' a '\r': c - '\t' sem sinal <= 4
+size_t pulaEspacosSse2(const char* p, size_t n) {
+    const __m128i branco = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), quatro = _mm_set1_epi8(4);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i d = _mm_sub_epi8(v, tab);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, branco), _mm_cmpeq_epi8(_mm_min_epu8(d, quatro), d));
+        unsigned bits = ~(unsigned)_mm_movemask_epi8(m) & 0xFFFF;
+        if (bits) return i + __builtin_ctz(bits);
+    }
+    return i + pulaEspacosEscalar(p + i, n - i);
+}
+
+// Soma os achados em contadores de 8 bits e esvazia com psadbw a cada 255 blocos
+uint64_t contaByteSse2(const char* p, size_t n, char c) {
+    const __m128i vc = _mm_set1_epi8(c), zero = _mm_setzero_si128();
+    uint64_t total = 0;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        __m128i soma = zero;
+        for (size_t k = 0; k < 255 && i + 16 <= n; k++, i += 16) {
+            soma = _mm_sub_epi8(soma, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), vc));
+        }
+        __m128i s = _mm_sad_epu8(soma, zero);
+        total += (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi16(s, 4);
+    }
+    return total + contaByteEscalar(p + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) size_t procuraAvx2(const char* p, size_t n, char a, char b, char c) {
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)), _mm256_cmpeq_epi8(v, vc));
+        if (unsigned bits = (unsigned)_mm256_movemask_epi8(m)) return i + __builtin_ctz(bits);
+    }
+    _mm256_zeroupper();
+    return i + procuraSse2(p + i, n - i, a, b, c);
+}
+
+__attribute__((target("avx2"))) size_t procuraParAvx2(const char* p, size_t n, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 33 <= n; i += 32) {
+        __m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i)), va),
+                                     _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i + 1)), vb));
+        if (unsigned bits = (unsigned)_mm256_movemask_epi8(m)) return i + __builtin_ctz(bits);
+    }
+    _mm256_zeroupper();
+    size_t k = procuraParSse2(p + i, n - i, a, b);
+    return k == n - i ? n : i + k;
+}
+
+__attribute__((target("avx2"))) size_t pulaEspacosAvx2(const char* p, size_t n) {
+    const __m256i branco = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), quatro = _mm256_set1_epi8(4);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i d = _mm256_sub_epi8(v, tab);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, branco), _mm256_cmpeq_epi8(_mm256_min_epu8(d, quatro), d));
+        if (unsigned bits = ~(unsigned)_mm256_movemask_epi8(m)) return i + __builtin_ctz(bits);
+    }
+    _mm256_zeroupper();
+    return i + pulaEspacosSse2(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) uint64_t contaByteAvx2(const char* p, size_t n, char c) {
+    const __m256i vc = _mm256_set1_epi8(c), zero = _mm256_setzero_si256();
+    uint64_t total = 0;
+    size_t i = 0;
+    while (i + 32 <= n) {
+        __m256i soma = zero;
+        for (size_t k = 0; k < 255 && i + 32 <= n; k++, i += 32) {
+            soma = _mm256_sub_epi8(soma, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i)), vc));
+        }
+        __m256i s = _mm256_sad_epu8(soma, zero);
+        total += (uint64_t)_mm256_extract_epi64(s, 0) + (uint64_t)_mm256_extract_epi64(s, 1) +
+                 (uint64_t)_mm256_extract_epi64(s, 2) + (uint64_t)_mm256_extract_epi64(s, 3);
+    }
+    _mm256_zeroupper();
+    return total + contaByteSse2(p + i, n - i, c);
+}
+#endif
+
+struct Varredura {
+    NivelSimd nivel;
+    size_t (*procura)(const char*, size_t, char, char, char);
+    size_t (*procuraPar)(const char*, size_t, char, char);
+    size_t (*pulaEspacos)(const char*, size_t);
+    uint64_t (*contaByte)(const char*, size_t, char);
+};
+
+// Melhor nivel suportado pela CPU, limitado a 'maximo'
+Varredura escolheVarredura(NivelSimd maximo) {
+#if VARREDURA_X86
+    if (maximo >= SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+        return {SIMD_AVX2, procuraAvx2, procuraParAvx2, pulaEspacosAvx2, contaByteAvx2};
+    }
+    if (maximo >= SIMD_SSE2) return {SIMD_SSE2, procuraSse2, procuraParSse2, pulaEspacosSse2, contaByteSse2};
+#else
+    (void)maximo;
+#endif
+    return {SIMD_ESCALAR, procuraEscalar, procuraParEscalar, pulaEspacosEscalar, contaByteEscalar};
+}
+
+// Escolhida antes de qualquer thread do lexico; so muda em main (--simd)
+Varredura varredura = escolheVarredura(SIMD_AVX2);
+
+// Roda o automato a partir de p[0] e devolve o tamanho do maior token aceito (0 se nenhum);
+// 'estado' fica com o estado de aceitacao (E_PARADA se nenhum)
+size_t escanear(const char* p, size_t n, unsigned& estado) {
+    if (p[0] == '"') {
+        // E_STR so sai em '"' (aceita) ou numa quebra (para sem aceitar)
+        size_t fim = 1 + varredura.procura(p + 1, n - 1, '"', '\r', '\n');
+        bool fechou = fim < n && p[fim] == '"';
+        estado = fechou ? E_STR_FIM : E_PARADA;
+        return fechou ? fim + 1 : 0;
+    }
+    unsigned e = E_INICIO;
+    size_t fim = 0;
+    estado = E_PARADA;
+    for (size_t j = 0; j < n; j++) {
+        e = scanner.prox[e][scanner.classe[(unsigned char)p[j]]];
+        if (e == E_PARADA) break;
+        if (scanner.aceite[e] != A_NAO) {
+            fim = j + 1;
+            estado = e;
+        }
+    }
+    return fim;
+}
+
+// Classifica o token pelo estado de aceitacao; erros lexicos saem como TK_ERRO_LEXICO
+TipoToken tipoLex(unsigned estado, const char* lex, size_t n, Sub& sub) {
+    sub = SUB_NENHUM;
+    switch (scanner.aceite[estado]) {
+        case A_ID:
+            sub = isPr(lex, n);
+            return sub != SUB_NENHUM ? TK_PALAVRA_RESERVADA : TK_IDENTIFICADOR;
+        case A_INT: return TK_NUM_INTEIRO;
+        case A_REAL: return TK_NUM_REAL;
+        case A_STR: return TK_STRING;
+        case A_SIMBOLO:
+            sub = (Sub)(estado == E_SIMBOLO ? scanner.subChar[(unsigned char)lex[0]] : scanner.sub[estado]);
+            return TK_SIMBOLO;
+        case A_COMPOSTO:
+            sub = (Sub)scanner.sub[estado];
+            return TK_SIMBOLO_COMPOSTO;
+        default: return TK_ERRO_LEXICO;
+    }
+}
+
+// Remove da linha os comentarios fechados '{...}' e '(*...*)', cada um trocado por um espaco.
+// Como no antigo regex, um comentario nao atravessa '\r'. 'origem' guarda, para cada
+// caractere de 'saida', a posicao dele na linha (npos para o espaco que substitui um
+// comentario). Devolve false (sem tocar em 'saida') quando a linha nao tem abertura de comentario.
+bool removeComentarios(const char* p, size_t n, string& saida, vector<size_t>& origem) {
+    size_t k = 0;
+    for (;; k++) {
+        k += varredura.procura(p + k, n - k, '{', '(', '(');
+        if (k >= n) return false;
+        if (p[k] == '{' || (k + 1 < n && p[k + 1] == '*')) break;
+    }
+
+    saida.clear();
+    origem.clear();
+    auto copia = [&](size_t de, size_t ate) {
+        saida.append(p + de, ate - de);
+        for (; de < ate; de++) origem.push_back(de);
+    };
+    copia(0, k);
+    size_t ini = k;
+    while (ini < n) {
+        size_t fim = ini + varredura.procura(p + ini, n - ini, '\r', '\n', '\n');
+
+        // Um '{' ou '(*' sem fechamento ate o fim do segmento e texto comum; depois da
+        // primeira busca que falha nenhuma abertura seguinte do mesmo tipo fecha
+        bool semChave = false, semFecha = false;
+        size_t i = ini;
+        while (i < fim) {
+            size_t j = i + varredura.procura(p + i, fim - i, '{', '(', '(');
+            copia(i, j);
+            i = j;
+            if (i == fim) break;
+            if (p[i] == '{' && !semChave) {
+                if (const char* c = (const char*)memchr(p + i + 1, '}', fim - i - 1)) {
+                    i = c - p + 1;
+                    saida += ' ';
+                    origem.push_back(string::npos);
+                    continue;
+                }
+                semChave = true;
+            } else if (p[i] == '(' && i + 2 < fim && p[i + 1] == '*' && !semFecha) {
+                size_t f = i + 2 + varredura.procuraPar(p + i + 2, fim - i - 2, '*', ')');
+                if (f < fim) {
+                    i = f + 2;
+                    saida += ' ';
+                    origem.push_back(string::npos);
+                    continue;
+                }
+                semFecha = true;
+            }
+            origem.push_back(i);
+            saida += p[i++];
+        }
+        if (fim < n) {
+            origem.push_back(fim);
+            saida += p[fim++];
+        }
+        ini = fim;
+    }
+    return true;
+}
+
+// Instrumentacao de --stats e --trace. Com -DINSTRUMENTACAO=0 as medicoes saem
+// do binario; ligadas, cada ponto medido custa um teste de ponteiro nulo quando
+// nenhuma das duas opcoes foi pedida
+#ifndef INSTRUMENTACAO
+#define INSTRUMENTACAO 1
+#endif
+constexpr bool instrumentado = INSTRUMENTACAO != 0;
+
+#if INSTRUMENTACAO
+// Alocacoes feitas por cada thread, contadas pelo operator new global. Ele aloca
+// com malloc, como o original, e os delete liberam com free; trocados juntos, os
+// sanitizers nao acusam alocacao e liberacao de familias diferentes
+thread_local uint64_t alocacoesThread = 0;
+
+void* operator new(size_t n) {
+    alocacoesThread++;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+
+// Fora de linha, como os da biblioteca: inlinado junto do new, o free confunde o -Wmismatched-new-delete
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#endif
+
+// Fases medidas. As rastreadas viram eventos no --trace; as outras rodam uma vez
+// por token ou por linha e so entram nos totais
+enum IdFase : uint8_t {
+    F_LEITURA, F_LEXICO_PARALELO, F_COMENTARIOS, F_TOKENIZACAO, F_CLASSIFICACAO, F_SINTATICO,
+    F_SEMANTICO, F_TABELA, F_INTERMEDIARIO, F_OTIMIZACAO, F_ASSEMBLY, F_EXECUCAO, NUM_FASES
+};
+struct InfoFase {
+    const char* nome;
+    bool rastreada;
 };
+constexpr InfoFase infoFase[NUM_FASES] = {
+    {"leitura", true}, {"lexico paralelo", true}, {"comentarios", false}, {"tokenizacao", false},
+    {"classificacao", false}, {"sintatico", true}, {"semantico", false}, {"tabela", false},
+    {"intermediario", true}, {"otimizacao", true}, {"assembly", true}, {"execucao", true}};
+
+enum IdContador : uint8_t { C_TOKENS, C_SINCRONIZA, C_BUSCAS, C_DIAGNOSTICOS, NUM_CONTADORES };
+constexpr const char* nomeContador[NUM_CONTADORES] = {"tokens", "sincroniza", "buscas na tabela", "diagnosticos"};
+
+// Tempo e alocacoes de uma compilacao por fase. Os totais sao exclusivos: quando
+// uma fase comeca dentro de outra (o sintatico puxa o lexico, que classifica os
+// tokens), o relogio da de fora para ate ela acabar. Conta so a thread que compila
+class Medidor {
+public:
+    using Relogio = chrono::steady_clock;
+    struct Totais {
+        uint64_t chamadas = 0, alocacoes = 0;
+        double segundos = 0;
+    };
+    struct Evento {
+        IdFase fase;
+        double inicioUs, duracaoUs; // desde a criacao do medidor
+        uint64_t alocacoes;
+    };
 
-bool isPr(const string& palavra) {
-    static const unordered_set<string> palavrasReservadas = {
-        "Program", "read", "write", "integer", "boolean", "double", "function", "procedure", "begin", "end",
-        "and", "array", "case", "const", "div", "do", "downto", "else", "file", "for", "goto", "if", "in",
-        "label", "mod", "nil", "not", "of", "or", "packed", "record", "repeat", "set", "then", "to", "type",
-        "until", "with", "var", "while", "true", "false"
+private:
+    struct Aberta {
+        IdFase fase;
+        Relogio::time_point entrada;
+        uint64_t alocEntrada;
     };
-    return palavrasReservadas.count(palavra);
+    Relogio::time_point inicio, ultimo;
+    uint64_t alocUltimo = 0;
+    vector<Aberta> pilha;
+    Totais totais[NUM_FASES];
+    uint64_t contadores[NUM_CONTADORES] = {};
+    bool rastrear;
+    vector<Evento> eventos;
+
+    static uint64_t alocacoes() {
+#if INSTRUMENTACAO
+        return alocacoesThread;
+#else
+        return 0;
+#endif
+    }
+
+    // Credita a fase do topo pelo que passou desde a ultima troca
+    void acumula(Relogio::time_point t, uint64_t a) {
+        if (!pilha.empty()) {
+            Totais& f = totais[pilha.back().fase];
+            f.segundos += chrono::duration<double>(t - ultimo).count();
+            f.alocacoes += a - alocUltimo;
+        }
+        ultimo = t;
+        alocUltimo = a;
+    }
+
+public:
+    explicit Medidor(bool rastrear = false) : inicio(Relogio::now()), ultimo(inicio), rastrear(rastrear) {
+        pilha.reserve(16); // as fases aninham pouco; a pilha nao aloca durante a medicao
+    }
+
+    void entra(IdFase f) {
+        Relogio::time_point t = Relogio::now();
+        uint64_t a = alocacoes();
+        acumula(t, a);
+        pilha.push_back({f, t, a});
+        totais[f].chamadas++;
+    }
+
+    void sai() {
+        Relogio::time_point t = Relogio::now();
+        uint64_t a = alocacoes();
+        acumula(t, a);
+        Aberta ab = pilha.back();
+        pilha.pop_back();
+        if (rastrear && infoFase[ab.fase].rastreada) {
+            eventos.push_back({ab.fase, chrono::duration<double, micro>(ab.entrada - inicio).count(),
+                               chrono::duration<double, micro>(t - ab.entrada).count(), a - ab.alocEntrada});
+        }
+    }
+
+    void conta(IdContador c, uint64_t n = 1) { contadores[c] += n; }
+
+    const Totais& fase(IdFase f) const { return totais[f]; }
+    uint64_t contador(IdContador c) const { return contadores[c]; }
+    const vector<Evento>& getEventos() const { return eventos; }
+    Relogio::time_point getInicio() const { return inicio; }
+    double decorridoUs() const { return chrono::duration<double, micro>(Relogio::now() - inicio).count(); }
+
+    void relata(ostream& rel) const {
+        rel << "\n- Fases (tempo exclusivo) -\n";
+        rel << left << setw(18) << "Fase" << right << setw(12) << "chamadas" << setw(12) << "ms" << setw(12) << "alocacoes" << "\n";
+        for (int f = 0; f < NUM_FASES; f++) {
+            if (!totais[f].chamadas) continue;
+            rel << left << setw(18) << infoFase[f].nome << right << setw(12) << totais[f].chamadas
+                << setw(12) << fixed << setprecision(3) << totais[f].segundos * 1000 << setw(12) << totais[f].alocacoes << "\n";
+        }
+        rel << "\n- Contadores -\n";
+        for (int c = 0; c < NUM_CONTADORES; c++) rel << left << setw(18) << nomeContador[c] << contadores[c] << "\n";
+        rel << left << setw(18) << "varredura" << nomeSimd[varredura.nivel] << "\n";
+    }
+};
+
+// Mede o bloco em que vive como a fase 'f'; sem medidor nao faz nada
+class MedeFase {
+    Medidor* m;
+
+public:
+    MedeFase(Medidor* med, IdFase f) : m(med) {
+        if constexpr (instrumentado) {
+            if (m) m->entra(f);
+        }
+    }
+    ~MedeFase() {
+        if constexpr (instrumentado) {
+            if (m) m->sai();
+        }
+    }
+    MedeFase(const MedeFase&) = delete;
+    MedeFase& operator=(const MedeFase&) = delete;
+};
+
+inline void registra(Medidor* m, IdContador c, uint64_t n = 1) {
+    if constexpr (instrumentado) {
+        if (m) m->conta(c, n);
+    }
 }
 
-string tipoLex(const string& lex) {
-    static regex numReal(R"(^\d+\.\d+$)");
-    static regex numInt(R"(^\d+$)");
-    static regex id(R"(^[a-zA-Z_][a-zA-Z0-9_]*$)");
-    static regex numRuim(R"(^\d*\.\d+\.\d*$)"); // detecta números com múltiplos ponto
-    static regex strLiteral(R"(^\".*\"$)");
+// Pool de threads com roubo de trabalho. As tarefas sao repartidas entre as
+// filas das threads; cada uma consome a propria pela frente e, quando ela
+// acaba, rouba do fim da fila de outra
+class PoolTrabalho {
+    struct Fila {
+        mutex m;
+        deque<function<void()>> tarefas;
+    };
+
+    vector<unique_ptr<Fila>> filas;
+    vector<thread> threads;
+    size_t proxima = 0;
+
+    bool pega(size_t dona, function<void()>& tarefa) {
+        {
+            Fila& f = *filas[dona];
+            lock_guard<mutex> trava(f.m);
+            if (!f.tarefas.empty()) {
+                tarefa = move(f.tarefas.front());
+                f.tarefas.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < filas.size(); k++) {
+            Fila& f = *filas[(dona + k) % filas.size()];
+            lock_guard<mutex> trava(f.m);
+            if (!f.tarefas.empty()) {
+                tarefa = move(f.tarefas.back());
+                f.tarefas.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit PoolTrabalho(unsigned numThreads) {
+        for (unsigned t = 0; t < max(numThreads, 1u); t++) filas.push_back(make_unique<Fila>());
+    }
+
+    ~PoolTrabalho() {
+        espera();
+    }
+
+    // Distribui em rodizio; chamar antes de 'inicia'
+    void adiciona(function<void()> tarefa) {
+        size_t alvo = proxima++ % filas.size();
+        filas[alvo]->tarefas.push_back(move(tarefa));
+    }
+
+    // Ninguem cria tarefa depois de comecar, entao cada thread para quando nao acha mais o que roubar
+    void inicia() {
+        for (size_t t = 0; t < filas.size(); t++) {
+            threads.emplace_back([this, t] {
+                function<void()> tarefa;
+                while (pega(t, tarefa)) tarefa();
+            });
+        }
+    }
+
+    void espera() {
+        for (thread& t : threads) t.join();
+        threads.clear();
+    }
+
+};
+
+// Diagnosticos. Cada um e guardado como codigo, linha, coluna e argumentos; a
+// mensagem so e montada a partir do modelo do codigo quando for impressa
+enum CodigoDiag : uint8_t {
+    L_NUMERO, L_CARACTERE, L_SEQUENCIA, L_COMENT_CHAVE, L_COMENT_PAR, L_COMENT_FIM, L_ARQUIVO,
+    S_FIM_INESPERADO, S_ESPERAVA, S_ADICIONAIS, S_ID_DECLARACAO, S_DOIS_PONTOS, S_PV_DECLARACAO,
+    S_ESPERAVA_TIPO, S_PV_INSTRUCAO, S_COMANDO, S_ATRIB_IGUAL, S_TOKEN_INESPERADO, S_SEM_TOKENS,
+    S_PROFUNDIDADE,
+    M_NAO_DECLARADA, M_REDECLARACAO, M_ATRIBUICAO, M_IF, M_WHILE, M_RELACIONAL, M_OR, M_AND,
+    M_INTEIROS, M_ARITMETICA, M_NOT, M_INTEIRO_GRANDE, NUM_DIAG
+};
+enum Gravidade : uint8_t { G_ERRO, G_AVISO };
+enum FaseDiag : uint8_t { D_LEXICO, D_SINTATICO, D_SEMANTICO };
+
+constexpr const char* nomeGravidade[] = {"erro", "aviso"};
+constexpr const char* nomeFaseDiag[] = {"lexico", "sintatico", "semantico"};
+
+// %0, %1 e %2 no modelo sao os argumentos. Sem linha, o modelo e a mensagem inteira;
+// com linha ela comeca por "Erro <fase> linha N: "
+struct InfoDiag {
+    const char* codigo;
+    FaseDiag fase;
+    Gravidade gravidade;
+    bool comLinha;
+    const char* modelo;
+};
+constexpr InfoDiag infoDiag[NUM_DIAG] = {
+    {"L001", D_LEXICO, G_ERRO, true, "Numero invalido '%0'"},
+    {"L002", D_LEXICO, G_ERRO, true, "Caractere '%0' nao identificado"},
+    {"L003", D_LEXICO, G_ERRO, true, "Sequencia '%0' nao identificada"},
+    {"L004", D_LEXICO, G_ERRO, true, "Comentario '{' nao fechado"},
+    {"L005", D_LEXICO, G_ERRO, true, "Comentario '(*' nao fechado"},
+    {"L006", D_LEXICO, G_ERRO, true, "Comentario '(*' nao fechado no fim do arquivo"},
+    {"L007", D_LEXICO, G_ERRO, false, "Erro: Nao abriu arquivo '%0'"},
+    {"S001", D_SINTATICO, G_ERRO, true, "Fim de arquivo inesperado. Esperava '%0'."},
+    {"S002", D_SINTATICO, G_ERRO, true, "Esperava %0 '%1', mas encontrou '%2'."},
+    {"S003", D_SINTATICO, G_ERRO, true, "Tokens adicionais depois do fim do programa."},
+    {"S004", D_SINTATICO, G_ERRO, true, "Esperava um identificador para iniciar a declaracao."},
+    {"S005", D_SINTATICO, G_ERRO, true, "Falta ':' antes do tipo '%0'."},
+    {"S006", D_SINTATICO, G_ERRO, true, "Falta ';' no final da declaracao."},
+    {"S007", D_SINTATICO, G_ERRO, true, "Esperava um tipo (integer, double, boolean), mas encontrou '%0'."},
+    {"S008", D_SINTATICO, G_ERRO, true, "Falta ';' no final da instrucao."},
+    {"S009", D_SINTATICO, G_ERRO, true, "Comando invalido ou inesperado '%0'."},
+    {"S010", D_SINTATICO, G_ERRO, true, "Operador de atribuicao invalido '='. Use ':='."},
+    {"S011", D_SINTATICO, G_ERRO, true, "Token inesperado '%0' na expressao."},
+    {"S012", D_SINTATICO, G_ERRO, false, "Erro sintatico: Nao ha tokens para analisar."},
+    {"S013", D_SINTATICO, G_ERRO, true, "Aninhamento passa do limite de %0 niveis (--max-profundidade); trecho ignorado."},
+    {"M001", D_SEMANTICO, G_ERRO, true, "Variavel '%0' nao declarada."},
+    {"M002", D_SEMANTICO, G_ERRO, true, "Redeclaracao da variavel '%0'."},
+    {"M003", D_SEMANTICO, G_ERRO, true, "Atribuicao de tipo '%0' para variavel '%1' do tipo %2."},
+    {"M004", D_SEMANTICO, G_ERRO, true, "Expressao do 'if' deve ser booleana, encontrou %0."},
+    {"M005", D_SEMANTICO, G_ERRO, true, "Expressao do 'while' deve ser booleana, encontrou %0."},
+    {"M006", D_SEMANTICO, G_ERRO, true, "Tipos incompativeis na operacao relacional '%0' (%1 e %2)."},
+    {"M007", D_SEMANTICO, G_ERRO, true, "Operador 'or' requer operandos booleanos, encontrou %0 e %1."},
+    {"M008", D_SEMANTICO, G_ERRO, true, "Operador 'and' requer operandos booleanos, encontrou %0 e %1."},
+    {"M009", D_SEMANTICO, G_ERRO, true, "Operador '%0' requer operandos inteiros, encontrou %1 e %2."},
+    {"M010", D_SEMANTICO, G_ERRO, true, "Tipos incompativeis na operacao '%0' (%1 e %2)."},
+    {"M011", D_SEMANTICO, G_ERRO, true, "Operador 'not' requer operando booleano, encontrou %0."},
+    {"M012", D_SEMANTICO, G_ERRO, true, "Inteiro '%0' fora do intervalo (maximo 9223372036854775807)."}};
+
+// --max-erros e --sem-repetidos
+struct LimiteDiag {
+    size_t maximo = SIZE_MAX;  // diagnosticos guardados; os seguintes so sao contados
+    bool semRepetidos = false; // descarta mensagem igual a uma ja guardada
+};
+
+// Lista de diagnosticos de uma fase. O texto dos argumentos (lexemas, nomes,
+// tipos) e copiado para um pool da lista, entao ela nao depende da Fonte que
+// os produziu e pode ser costurada, recortada e impressa depois
+class Diagnosticos {
+public:
+    static constexpr int MAX_ARGS = 3;
+    struct Arg {
+        uint64_t inicio; // no pool
+        uint32_t tamanho;
+    };
+    struct Diagnostico {
+        uint64_t linha;
+        uint32_t coluna; // 0 se desconhecida
+        CodigoDiag codigo;
+        uint8_t numArgs;
+        Arg args[MAX_ARGS];
+    };
+
+private:
+    vector<Diagnostico> lista;
+    string textos;
+    LimiteDiag limite;
+    uint64_t omitidos = 0, repetidos = 0;
+    unordered_multimap<size_t, size_t> vistos; // hash da mensagem -> indice, com semRepetidos
+
+    size_t hashDe(const Diagnostico& d) const {
+        size_t h = hash<uint64_t>()(d.linha * NUM_DIAG + d.codigo);
+        for (int k = 0; k < d.numArgs; k++) h = h * 31 + hash<string_view>()(arg(d, k));
+        return h;
+    }
+
+    bool iguais(const Diagnostico& a, const Diagnostico& b) const {
+        if (a.codigo != b.codigo || a.linha != b.linha) return false;
+        for (int k = 0; k < a.numArgs; k++) {
+            if (arg(a, k) != arg(b, k)) return false;
+        }
+        return true;
+    }
+
+    // Guarda o ultimo de 'lista' como visto; false se ja havia um igual
+    bool novo() {
+        size_t h = hashDe(lista.back());
+        auto faixa = vistos.equal_range(h);
+        for (auto it = faixa.first; it != faixa.second; ++it) {
+            if (iguais(lista[it->second], lista.back())) return false;
+        }
+        vistos.emplace(h, lista.size() - 1);
+        return true;
+    }
+
+    void emite(CodigoDiag c, uint64_t linha, uint32_t coluna, const string_view* args, size_t n) {
+        if (lista.size() >= limite.maximo) {
+            omitidos++;
+            return;
+        }
+        Diagnostico d{linha, coluna, c, (uint8_t)n, {}};
+        size_t tamTextos = textos.size();
+        for (size_t k = 0; k < n; k++) {
+            d.args[k] = {textos.size(), (uint32_t)args[k].size()};
+            textos.append(args[k]);
+        }
+        lista.push_back(d);
+        if (limite.semRepetidos && !novo()) {
+            lista.pop_back();
+            textos.resize(tamTextos);
+            repetidos++;
+        }
+    }
+
+public:
+    void configura(const LimiteDiag& l) { limite = l; }
+
+    void emite(CodigoDiag c, uint64_t linha, uint32_t coluna, initializer_list<string_view> args = {}) {
+        emite(c, linha, coluna, args.begin(), args.size());
+    }
+
+    // Acrescenta os diagnosticos [de, ate) de 'outra', com as linhas deslocadas de
+    // 'deltaLinha'. As contagens de omitidos e repetidos so vem com a lista inteira
+    void anexa(const Diagnosticos& outra, int64_t deltaLinha = 0, size_t de = 0, size_t ate = SIZE_MAX) {
+        ate = min(ate, outra.lista.size());
+        string_view args[MAX_ARGS];
+        for (size_t i = de; i < ate; i++) {
+            const Diagnostico& d = outra.lista[i];
+            for (int k = 0; k < d.numArgs; k++) args[k] = outra.arg(d, k);
+            emite(d.codigo, d.linha + (uint64_t)deltaLinha, d.coluna, args, d.numArgs);
+        }
+        if (de == 0 && ate == outra.lista.size()) {
+            omitidos += outra.omitidos;
+            repetidos += outra.repetidos;
+        }
+    }
+
+    string_view arg(const Diagnostico& d, int k) const {
+        return string_view(textos).substr(d.args[k].inicio, d.args[k].tamanho);
+    }
+
+    // Texto do modelo com os argumentos, sem o prefixo
+    string corpo(const Diagnostico& d) const {
+        string r;
+        for (const char* p = infoDiag[d.codigo].modelo; *p; p++) {
+            if (p[0] == '%' && p[1] >= '0' && p[1] < '0' + d.numArgs) {
+                r += arg(d, *++p - '0');
+            } else {
+                r += *p;
+            }
+        }
+        return r;
+    }
+
+    // Mensagem completa, como sai no relatorio
+    string mensagem(size_t i) const {
+        const Diagnostico& d = lista[i];
+        const InfoDiag& info = infoDiag[d.codigo];
+        if (!info.comLinha) return corpo(d) + "\n";
+        return string("Erro ") + nomeFaseDiag[info.fase] + " linha " + to_string(d.linha) + ": " + corpo(d) + "\n";
+    }
+
+    const Diagnostico& operator[](size_t i) const { return lista[i]; }
+    size_t tamanho() const { return lista.size(); }           // guardados
+    uint64_t total() const { return lista.size() + omitidos + repetidos; }
+    uint64_t getOmitidos() const { return omitidos; }
+    uint64_t getRepetidos() const { return repetidos; }
+    bool vazio() const { return total() == 0; }
+};
+
+// Arquivos menores que dois trechos sao lidos por uma thread so
+constexpr uint64_t TAM_MIN_TRECHO = 4u << 20;
+
+// Analisador lexico puxado sob demanda: cada chamada de proximo() le so o
+// necessario para produzir o proximo token, entao a memoria nao cresce com a entrada.
+// Arquivos grandes podem ser lidos antes, em trechos paralelos (preparaParalelo)
+class Lexico {
+    Fonte& fonte;
+    Internador& nomes;
+    Diagnosticos erros;
+    string_view texto;
+    uint64_t fimTexto;
+
+    uint64_t inicioLinha = 0; // deslocamento da proxima linha a carregar
+    uint64_t numLinha = 0;
+    bool comentAberto = false;
+    bool terminou = false;
+    bool fimArquivo = true;   // o texto lido acaba no fim do arquivo
 
-    if (isPr(lex)) return "Palavra reservada";
-    if (regex_match(lex, strLiteral)) return "String literal";
-    if (regex_match(lex, numReal)) return "Numero real";
-    if (regex_match(lex, numInt)) return "Numero inteiro";
-    if (regex_match(lex, id)) return "Identificador";
-    if (regex_match(lex, numRuim)) return "numero_invalido";
+    // Num trecho os lexemas reescritos ficam aqui ate a costura, com
+    // deslocamentos como se fossem os primeiros depois do arquivo
+    bool emTrecho = false;
+    string reescritos;
+    Medidor* medidor = nullptr;
+
+public:
+    // Trecho de linhas inteiras lido a parte (por uma thread, ou linhas editadas),
+    // com ids e reescritos locais
+    struct Trecho {
+        uint64_t inicio = 0, fim = 0;
+        uint64_t linhaBase = 0;     // linhas antes do trecho
+        bool comentInicial = false; // '(*' aberto antes do trecho (nos paralelos, um palpite)
+        bool fimArquivo = false;    // o trecho acaba no fim do arquivo
+        bool comentFinal = false;
+        Internador nomes;
+        vector<Simbolo> tokens;
+        Diagnosticos erros;
+        string reescritos;
+    };
+
+private:
+    vector<Trecho> trechos;
+    size_t trechoAtual = 0;
+    size_t posTrecho = 0;
+
+    // linha atual: tokens sao lidos de p[i..n); 'base' e o inicio do trecho sem
+    // comentarios no arquivo, usado com 'origem' quando a linha foi reescrita
+    const char* linha = nullptr;
+    const char* base = nullptr;
+    const char* p = nullptr;
+    size_t n = 0;
+    size_t i = 0;
+    bool reescrita = false;
+    string semComentarios;
+    vector<size_t> origem;
+
+    bool carregaLinha() {
+        while (inicioLinha < fimTexto) {
+            if (comentAberto && !pulaComentario()) break;
+            linha = texto.data() + inicioLinha;
+            const char* nl = (const char*)memchr(linha, '\n', fimTexto - inicioLinha);
+            n = nl ? (size_t)(nl - linha) : fimTexto - inicioLinha;
+            inicioLinha += n + 1;
+            numLinha++;
+
+            p = linha;
+            i = 0;
+
+            MedeFase fase(medidor, F_COMENTARIOS);
+            if (comentAberto) {
+                size_t fimCom = string_view(p, n).find("*)");
+                if (fimCom != string::npos) { // string::npos = não encontrado
+                    comentAberto = false;
+                    p += fimCom + 2; // pula 2 caracteres
+                    n -= fimCom + 2;
+                } else {
+                    continue;
+                }
+            }
+
+            // Sem comentario na linha os tokens sao lidos direto do arquivo; com comentario,
+            // de 'semComentarios', e cada lexema volta a apontar para o arquivo via 'origem'
+            base = p;
+            reescrita = removeComentarios(p, n, semComentarios, origem);
+            if (reescrita) {
+                size_t poscoment1 = semComentarios.find('{');
+                if (poscoment1 != string::npos && semComentarios.find('}', poscoment1) == string::npos) {
+                    erros.emite(L_COMENT_CHAVE, numLinha, colunaReescrita(poscoment1));
+                    semComentarios.resize(poscoment1);
+                }
+
+                size_t poscomment2 = semComentarios.find("(*");
+                if (poscomment2 != string::npos && semComentarios.find("*)", poscomment2 + 2) == string::npos) {
+                    erros.emite(L_COMENT_PAR, numLinha, colunaReescrita(poscomment2));
+                    comentAberto = true;
+                    semComentarios.resize(poscomment2);
+                }
+                p = semComentarios.data();
+                n = semComentarios.size();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Com '(*' aberto, vai direto para a linha do '*)' contando as quebras no caminho;
+    // devolve false se o comentario vai ate o fim do texto
+    bool pulaComentario() {
+        MedeFase fase(medidor, F_COMENTARIOS);
+        const char* ini = texto.data() + inicioLinha;
+        size_t resto = fimTexto - inicioLinha;
+        size_t fimCom = varredura.procuraPar(ini, resto, '*', ')');
+        if (fimCom == resto) {
+            numLinha += varredura.contaByte(ini, resto, '\n') + (ini[resto - 1] != '\n');
+            inicioLinha = fimTexto;
+            return false;
+        }
+        size_t inicio = fimCom;
+        while (inicio > 0 && ini[inicio - 1] != '\n') inicio--;
+        numLinha += varredura.contaByte(ini, inicio, '\n');
+        inicioLinha += inicio;
+        return true;
+    }
+
+    // Coluna no arquivo do caractere 'k' da linha sem comentarios
+    uint32_t colunaReescrita(size_t k) const {
+        return (uint32_t)min<size_t>(base - linha + origem[k] + 1, UINT32_MAX);
+    }
+
+    uint64_t guarda(string_view lex) {
+        if (!emTrecho) return fonte.guarda(lex);
+        uint64_t pos = texto.size() + reescritos.size();
+        reescritos.append(lex);
+        return pos;
+    }
+
+    Lexico(Fonte& f, Trecho& t)
+        : fonte(f), nomes(t.nomes), texto(f.texto()), fimTexto(t.fim), inicioLinha(t.inicio),
+          numLinha(t.linhaBase), comentAberto(t.comentInicial), fimArquivo(t.fimArquivo), emTrecho(true) {}
+
+    // Palpite do estado de comentario no inicio do trecho: o marcador '(*' ou '*)'
+    // mais proximo antes dele. Um palpite errado so custa reler o trecho
+    bool palpiteComentario(uint64_t inicio) const {
+        uint64_t limite = inicio > (64u << 10) ? inicio - (64u << 10) : 0;
+        for (uint64_t k = inicio; k >= limite + 2; k--) {
+            if (texto[k - 2] == '(' && texto[k - 1] == '*') return true;
+            if (texto[k - 2] == '*' && texto[k - 1] == ')') return false;
+        }
+        return false;
+    }
+
+public:
+    Lexico(Fonte& f, Internador& nomes) : fonte(f), nomes(nomes), texto(f.texto()), fimTexto(texto.size()) {}
+
+    // Mede comentarios, tokenizacao e classificacao em 'm' (nulo desliga)
+    void instrumenta(Medidor* m) { medidor = m; }
+
+    // Le um trecho sozinho; 'f' so e lida
+    static void lexTrecho(Fonte& f, Trecho& t) {
+        t.nomes = Internador();
+        t.tokens.clear();
+        Lexico lex(f, t);
+        Simbolo simb;
+        while (lex.proximo(simb)) t.tokens.push_back(simb);
+        t.comentFinal = lex.comentAberto;
+        t.erros = move(lex.erros);
+        t.reescritos = move(lex.reescritos);
+    }
+
+    // Le o arquivo inteiro de uma vez, em trechos de linhas nas threads do pool, e depois
+    // costura os trechos em ordem. O unico estado que passa de uma linha para a outra e
+    // o comentario '(*' aberto: cada trecho comeca com um palpite e e relido se errou.
+    // Ids e reescritos de cada trecho sao locais e renumerados na costura, na mesma
+    // ordem da leitura sequencial, entao tokens e erros saem identicos a ela
+    void preparaParalelo(unsigned numThreads) {
+        if (numThreads < 2 || texto.size() < 2 * TAM_MIN_TRECHO || inicioLinha != 0) return;
+        MedeFase fase(medidor, F_LEXICO_PARALELO);
+
+        uint64_t alvo = max<uint64_t>(TAM_MIN_TRECHO, texto.size() / (numThreads * 4u));
+        vector<uint64_t> cortes{0};
+        while (texto.size() - cortes.back() > alvo) {
+            const char* nl = (const char*)memchr(texto.data() + cortes.back() + alvo, '\n', texto.size() - cortes.back() - alvo);
+            if (!nl) break;
+            uint64_t corte = (uint64_t)(nl - texto.data()) + 1;
+            if (corte == texto.size()) break;
+            cortes.push_back(corte);
+        }
+        if (cortes.size() < 2) return;
+        cortes.push_back(texto.size());
+
+        trechos.resize(cortes.size() - 1);
+        vector<uint64_t> quebras(trechos.size(), 0);
+        {
+            PoolTrabalho pool(numThreads);
+            for (size_t k = 0; k < trechos.size(); k++) {
+                trechos[k].inicio = cortes[k];
+                trechos[k].fim = cortes[k + 1];
+                pool.adiciona([&, k] {
+                    quebras[k] = varredura.contaByte(texto.data() + cortes[k], cortes[k + 1] - cortes[k], '\n');
+                });
+            }
+            pool.inicia();
+        }
+        {
+            PoolTrabalho pool(numThreads);
+            for (size_t k = 0; k < trechos.size(); k++) {
+                if (k > 0) trechos[k].linhaBase = trechos[k - 1].linhaBase + quebras[k - 1];
+                trechos[k].comentInicial = k > 0 && palpiteComentario(trechos[k].inicio);
+                trechos[k].fimArquivo = k + 1 == trechos.size();
+                pool.adiciona([&, k] { lexTrecho(fonte, trechos[k]); });
+            }
+            pool.inicia();
+        }
+
+        bool coment = false;
+        vector<uint32_t> mapa;
+        for (Trecho& t : trechos) {
+            if (t.comentInicial != coment) {
+                t.comentInicial = coment;
+                lexTrecho(fonte, t);
+            }
+            coment = t.comentFinal;
+
+            mapa.resize(t.nomes.tamanho());
+            for (uint32_t j = 0; j < mapa.size(); j++) mapa[j] = nomes.id(t.nomes.nome((uint32_t)j));
+            uint64_t desloc = t.reescritos.empty() ? 0 : fonte.guarda(t.reescritos) - texto.size();
+            for (Simbolo& simb : t.tokens) {
+                if (simb.id != SEM_ID) simb.id = mapa[simb.id];
+                if (simb.inicio >= texto.size()) simb.inicio += desloc;
+            }
+            erros.anexa(t.erros);
+            t.erros = Diagnosticos();
+            t.nomes = Internador();
+            string().swap(t.reescritos);
+        }
+        inicioLinha = texto.size();
+        numLinha = trechos.back().linhaBase + quebras.back();
+    }
+
+    // Preenche 'simb' com o proximo token; devolve false no fim do arquivo
+    bool proximo(Simbolo& simb) {
+        while (trechoAtual < trechos.size()) {
+            Trecho& t = trechos[trechoAtual];
+            if (posTrecho < t.tokens.size()) {
+                simb = t.tokens[posTrecho++];
+                return true;
+            }
+            vector<Simbolo>().swap(t.tokens);
+            trechoAtual++;
+            posTrecho = 0;
+            terminou = true;
+        }
+        MedeFase fase(medidor, F_TOKENIZACAO);
+        while (!terminou) {
+            while (i < n) {
+                unsigned char c = scanner.classe[(unsigned char)p[i]];
+                if (c == CL_ESPACO || c == CL_QUEBRA) {
+                    i++;
+                    if (i < n && ehEspaco(p[i])) i += varredura.pulaEspacos(p + i, n - i);
+                    continue;
+                }
+
+                unsigned estado;
+                size_t tam = escanear(p + i, n - i, estado);
+                if (tam == 0) {
+                    // caractere fora do alfabeto; uma sequencia UTF-8 vira um lexema so
+                    tam = 1;
+                    if ((unsigned char)p[i] >= 0xC0) {
+                        while (i + tam < n && ((unsigned char)p[i + tam] & 0xC0) == 0x80) tam++;
+                    }
+                }
+
+                string_view lex(p + i, tam);
+                size_t coluna;
+                simb.tamanho = (uint32_t)tam;
+                simb.linha = numLinha;
+                if (reescrita) {
+                    size_t ini = origem[i], ult = origem[i + tam - 1];
+                    coluna = base - linha + ini + 1;
+                    if (ini != string::npos && ult == ini + tam - 1) simb.inicio = (uint64_t)(base + ini - texto.data());
+                    else simb.inicio = guarda(lex); // string literal que engoliu um comentario
+                } else {
+                    coluna = p - linha + i + 1;
+                    simb.inicio = (uint64_t)(p + i - texto.data());
+                }
+                simb.coluna = (uint32_t)min<size_t>(coluna, UINT32_MAX);
+                i += tam;
+
+                MedeFase classificacao(medidor, F_CLASSIFICACAO);
+                simb.tipo = tipoLex(estado, lex.data(), lex.size(), simb.sub);
+                simb.id = simb.tipo == TK_IDENTIFICADOR ? nomes.id(fonte.lexema(simb)) : SEM_ID;
+
+                if (simb.tipo == TK_ERRO_LEXICO) {
+                    CodigoDiag c = scanner.aceite[estado] == A_RUIM ? L_NUMERO
+                                 : lex.length() == 1 && !isalnum((unsigned char)lex[0]) ? L_CARACTERE
+                                                                                      : L_SEQUENCIA;
+                    erros.emite(c, numLinha, simb.coluna, {lex});
+                }
+                return true;
+            }
+
+            if (!carregaLinha()) {
+                terminou = true;
+                if (comentAberto && fimArquivo) {
+                    erros.emite(L_COMENT_FIM, numLinha, 0);
+                }
+            }
+        }
+        return false;
+    }
+
+    const Diagnosticos& getErros() const {
+        return erros;
+    }
+
+    void configuraErros(const LimiteDiag& limite) { erros.configura(limite); }
+};
+
+pair<vector<Simbolo>, Diagnosticos> analisarLexico(const string& arquivo, Fonte& fonte, Internador& nomes) { // separar em tokens
+    vector<Simbolo> tabela;
+
+    if (!fonte.abrir(arquivo)) {
+        Diagnosticos erros;
+        erros.emite(L_ARQUIVO, 0, 0, {arquivo});
+        return {tabela, move(erros)};
+    }
+
+    Lexico lexico(fonte, nomes);
+    Simbolo simb;
+    while (lexico.proximo(simb)) {
+        tabela.push_back(simb);
+    }
+    return {move(tabela), lexico.getErros()};
+}
+
+// Fluxo de tokens consumido pelo parser. Guarda so uma janela (anel) com o token
+// anterior e o atual; o parser nunca volta atras. Cada token puxado do lexico
+// passa pelo 'tee', se houver.
+class FluxoTokens {
+    Lexico* lexico;
+    const vector<Simbolo>* lista = nullptr; // tokens ja lidos, no lugar do lexico
+    static constexpr uint64_t TAM_ANEL = 4; // potencia de 2
+    Simbolo anel[TAM_ANEL];
+    uint64_t lidos = 0;  // tokens ja puxados do lexico
+    uint64_t pos = 0;    // token atual
+    bool acabou = false;
+    Simbolo fimArquivo{0, 0, 0, 0, SEM_ID, TK_EOF, SUB_NENHUM};
+    function<void(const Simbolo&)> tee;
+
+    bool carrega(uint64_t k) {
+        while (lidos <= k) {
+            if (acabou) return false;
+            Simbolo s;
+            bool tem = lexico ? lexico->proximo(s) : lidos < lista->size();
+            if (tem && !lexico) s = (*lista)[lidos];
+            if (!tem) {
+                acabou = true;
+                if (lidos > 0) fimArquivo.linha = anel[(lidos - 1) % TAM_ANEL].linha + 1;
+                return false;
+            }
+            anel[lidos % TAM_ANEL] = s;
+            lidos++;
+            if (tee) tee(s);
+        }
+        return true;
+    }
+
+public:
+    FluxoTokens(Lexico& lex, function<void(const Simbolo&)> tee = nullptr)
+        : lexico(&lex), tee(move(tee)) {}
+
+    explicit FluxoTokens(const vector<Simbolo>& tokens) : lexico(nullptr), lista(&tokens) {}
+
+    Simbolo atual() {
+        return carrega(pos) ? anel[pos % TAM_ANEL] : fimArquivo;
+    }
+
+    // Token anterior ao atual (o primeiro, se ainda nao houve avanco)
+    Simbolo anterior() {
+        uint64_t k = pos > 0 ? pos - 1 : 0;
+        return carrega(k) ? anel[k % TAM_ANEL] : fimArquivo;
+    }
+
+    // Token EOF; a linha dele so e conhecida depois que o lexico chega ao fim
+    const Simbolo& fim() const { return fimArquivo; }
+
+    bool vazio() { return !carrega(0); }
+
+    void avanca() {
+        if (carrega(pos)) pos++;
+    }
+
+    // Indice do token atual
+    uint64_t posicao() const { return pos; }
+
+    // O parser ja olhou alem do ultimo token
+    bool esgotado() const { return acabou; }
+
+    // Tokens ja puxados
+    uint64_t total() const { return lidos; }
+
+    // Puxa o resto do arquivo (para o tee e para os erros lexicos)
+    void esgota() {
+        while (carrega(lidos)) {}
+    }
+};
+
+
+// Tipos semanticos sao ids pequenos; o nome so entra nas mensagens. T_DESCONHECIDO
+// e o tipo de um operando que ja gerou o proprio erro
+enum Tipo : uint8_t { T_DESCONHECIDO, T_INTEGER, T_DOUBLE, T_BOOLEAN, T_STRING, NUM_TIPOS };
+
+constexpr string_view nomeTipo[NUM_TIPOS] = {"desconhecido", "integer", "double", "boolean", "string"};
+
+// Regra de um operador para um par de tipos: o tipo do resultado e o erro que a
+// combinacao gera (NUM_DIAG se ela vale)
+struct RegraTipo {
+    Tipo resultado;
+    CodigoDiag erro;
+};
+
+// Matriz operador x esquerdo x direito de todas as conferencias de tipo. 'not' e as
+// condicoes de if/while so olham o esquerdo; na atribuicao (':=') o esquerdo e o destino
+struct TabelaTipos {
+    RegraTipo regra[NUM_SUB][NUM_TIPOS][NUM_TIPOS] = {};
+
+    constexpr const RegraTipo& operator()(Sub op, Tipo a, Tipo b) const {
+        return regra[op][a][b];
+    }
+};
+
+// Um operando desconhecido nunca gera erro em cascata
+constexpr void poeRegra(TabelaTipos& t, Sub op, int a, int b, Tipo resultado, bool valida, CodigoDiag erro) {
+    bool desconhecido = a == T_DESCONHECIDO || b == T_DESCONHECIDO;
+    t.regra[op][a][b] = {resultado, valida || desconhecido ? NUM_DIAG : erro};
+}
+
+constexpr TabelaTipos montaTabelaTipos() {
+    TabelaTipos t;
+    for (int a = 0; a < NUM_TIPOS; a++) {
+        for (int b = 0; b < NUM_TIPOS; b++) {
+            bool inteiros = a == T_INTEGER && b == T_INTEGER;
+            bool booleanos = a == T_BOOLEAN && b == T_BOOLEAN;
+            bool numericos = (a == T_INTEGER || a == T_DOUBLE) && (b == T_INTEGER || b == T_DOUBLE);
+            Tipo aritmetico = !numericos ? T_DESCONHECIDO : a == T_DOUBLE || b == T_DOUBLE ? T_DOUBLE : T_INTEGER;
+            for (Sub s : {OP_IGUAL, OP_DIFERENTE, OP_MENOR, OP_MAIOR, OP_MENOR_IGUAL, OP_MAIOR_IGUAL}) {
+                poeRegra(t, s, a, b, T_BOOLEAN, a == b, M_RELACIONAL);
+            }
+            for (Sub s : {OP_MAIS, OP_MENOS, OP_VEZES, OP_BARRA}) poeRegra(t, s, a, b, aritmetico, numericos, M_ARITMETICA);
+            poeRegra(t, PR_OR, a, b, T_BOOLEAN, booleanos, M_OR);
+            poeRegra(t, PR_AND, a, b, T_BOOLEAN, booleanos, M_AND);
+            poeRegra(t, PR_DIV, a, b, T_INTEGER, inteiros, M_INTEIROS);
+            poeRegra(t, PR_MOD, a, b, T_INTEGER, inteiros, M_INTEIROS);
+            bool aceita = a == T_INTEGER ? b == T_INTEGER
+                        : a == T_DOUBLE  ? b == T_INTEGER || b == T_DOUBLE
+                        : a == T_BOOLEAN ? b == T_BOOLEAN
+                                         : true;
+            poeRegra(t, OP_ATRIB, a, b, (Tipo)a, aceita, M_ATRIBUICAO);
+            // Os unarios repetem em toda a linha a regra do operando
+            bool booleano = a == T_BOOLEAN || a == T_DESCONHECIDO;
+            t.regra[PR_NOT][a][b] = {T_BOOLEAN, booleano ? NUM_DIAG : M_NOT};
+            t.regra[PR_IF][a][b] = {T_BOOLEAN, booleano ? NUM_DIAG : M_IF};
+            t.regra[PR_WHILE][a][b] = {T_BOOLEAN, booleano ? NUM_DIAG : M_WHILE};
+        }
+    }
+    return t;
+}
+
+constexpr TabelaTipos regrasTipo = montaTabelaTipos();
+
+constexpr uint32_t SEM_NO = UINT32_MAX;
+
+// Alocador dos nos da arvore: blocos contiguos de tamanho fixo onde cada no e
+// so um indice de 32 bits. Os nos nao tem destrutor, entao liberar a arvore e
+// devolver os blocos, sem percorrer no por no
+template <class T>
+class Arena {
+    static_assert(is_trivially_destructible<T>::value, "nos da arena nao podem ter destrutor");
+    static constexpr uint32_t BITS_BLOCO = 14;
+    static constexpr uint32_t TAM_BLOCO = 1u << BITS_BLOCO;
+
+    vector<unique_ptr<T[]>> blocos;
+    uint32_t usados = 0;
+
+public:
+    uint32_t novo(const T& valor) {
+        if ((usados >> BITS_BLOCO) == blocos.size()) {
+            blocos.emplace_back(new T[TAM_BLOCO]);
+        }
+        (*this)[usados] = valor;
+        return usados++;
+    }
+
+    T& operator[](uint32_t i) {
+        return blocos[i >> BITS_BLOCO][i & (TAM_BLOCO - 1)];
+    }
+    const T& operator[](uint32_t i) const {
+        return blocos[i >> BITS_BLOCO][i & (TAM_BLOCO - 1)];
+    }
+
+    uint32_t tamanho() const {
+        return usados;
+    }
+
+    void libera() {
+        blocos.clear();
+        usados = 0;
+    }
+};
+
+enum ClasseNo : uint8_t {
+    N_PROGRAMA,   // filhos: bloco
+    N_BLOCO,      // filhos: declaracoes, comandos
+    N_DECLARACOES,// filhos: N_DECLARACAO...
+    N_DECLARACAO, // id e tipo da variavel
+    N_COMPOSTO,   // filhos: comandos (begin ... end)
+    N_ATRIBUICAO, // id do destino; filhos: expressao
+    N_LEITURA,    // filhos: N_VARIAVEL...
+    N_ESCRITA,    // filhos: expressoes
+    N_SE,         // filhos: condicao, entao[, senao]
+    N_ENQUANTO,   // filhos: condicao, corpo
+    N_BINARIO,    // op; filhos: esquerda, direita
+    N_UNARIO,     // op; filhos: operando
+    N_VARIAVEL,
+    N_INTEIRO,
+    N_REAL,
+    N_STRING,
+    N_BOOLEANO,   // op e PR_TRUE ou PR_FALSE
+    N_ERRO        // comando ou operando que nao foi reconhecido
+};
+
+// No da arvore sintatica. Os filhos formam uma lista: 'filho' aponta o primeiro
+// e cada um aponta o seguinte por 'prox'. O texto de literais vem da Fonte
+// por 'inicio' e 'tamanho', como nos tokens
+struct No {
+    uint64_t inicio;
+    uint64_t linha;
+    uint32_t tamanho;
+    uint32_t id;
+    uint32_t filho;
+    uint32_t prox;
+    Tipo tipo;
+    ClasseNo classe;
+    Sub op;
+};
+
+// Arvore de uma unidade de compilacao; dura enquanto a unidade precisar dela
+struct Arvore {
+    Arena<No> nos;
+    uint32_t raiz = SEM_NO;
+
+    // Encadeia os filhos em ordem; 'ultimo' e o filho anterior (SEM_NO no primeiro)
+    void anexa(uint32_t pai, uint32_t& ultimo, uint32_t no) {
+        if (ultimo == SEM_NO) nos[pai].filho = no;
+        else nos[ultimo].prox = no;
+        ultimo = no;
+    }
+};
+
+// Tabela de simbolos com escopos aninhados, indexada pelo id do Internador.
+// Cada id aponta a declaracao visivel mais interna, entao a busca e um acesso
+// a vetor sem olhar o nome. Entrar num escopo e O(1); sair desfaz so as
+// declaracoes feitas nele
+class TabelaSimbolos {
+public:
+    struct Declaracao {
+        uint32_t id;
+        uint32_t escopo;
+        uint32_t sombra; // declaracao do mesmo id que esta escondia (SEM_DECL se nenhuma)
+        Tipo tipo;
+    };
+    static constexpr uint32_t SEM_DECL = UINT32_MAX;
+
+private:
+    vector<Declaracao> decls;      // todas as declaracoes, na ordem em que aparecem
+    vector<uint32_t> visivel;      // id -> declaracao visivel
+    vector<uint32_t> desfazer;     // declaracoes dos escopos abertos, para sair deles
+    vector<uint32_t> inicioEscopo; // tamanho de 'desfazer' na entrada de cada escopo
+
+public:
+    void entraEscopo() {
+        inicioEscopo.push_back((uint32_t)desfazer.size());
+    }
+
+    void saiEscopo() {
+        uint32_t inicio = inicioEscopo.back();
+        inicioEscopo.pop_back();
+        while (desfazer.size() > inicio) {
+            const Declaracao& d = decls[desfazer.back()];
+            visivel[d.id] = d.sombra;
+            desfazer.pop_back();
+        }
+    }
+
+    const Declaracao* busca(uint32_t id) const {
+        if (id >= visivel.size() || visivel[id] == SEM_DECL) return nullptr;
+        return &decls[visivel[id]];
+    }
+
+    const vector<Declaracao>& declaracoes() const {
+        return decls;
+    }
+
+    // Falha se o id ja foi declarado no escopo atual; de escopos externos ele so fica escondido
+    bool declara(uint32_t id, Tipo tipo) {
+        if (id >= visivel.size()) visivel.resize(id + 1, SEM_DECL);
+        uint32_t escopo = (uint32_t)inicioEscopo.size();
+        uint32_t atual = visivel[id];
+        if (atual != SEM_DECL && decls[atual].escopo == escopo) return false;
+        visivel[id] = (uint32_t)decls.size();
+        desfazer.push_back(visivel[id]);
+        decls.push_back({id, escopo, atual, tipo});
+        return true;
+    }
+};
+
+// Precedencia dos operadores binarios, do mais fraco ao mais forte; 0 nao e
+// operador binario. Todos associam a esquerda
+enum Precedencia : uint8_t { PREC_NENHUMA, PREC_RELACIONAL, PREC_ADITIVA, PREC_MULTIPLICATIVA };
+
+struct TabelaPrecedencia {
+    uint8_t de[NUM_SUB] = {};
+};
+
+constexpr TabelaPrecedencia montaPrecedencia() {
+    TabelaPrecedencia t;
+    for (Sub s : {OP_IGUAL, OP_DIFERENTE, OP_MENOR, OP_MAIOR, OP_MENOR_IGUAL, OP_MAIOR_IGUAL}) t.de[s] = PREC_RELACIONAL;
+    for (Sub s : {OP_MAIS, OP_MENOS, PR_OR}) t.de[s] = PREC_ADITIVA;
+    for (Sub s : {OP_VEZES, OP_BARRA, PR_AND, PR_DIV, PR_MOD}) t.de[s] = PREC_MULTIPLICATIVA;
+    return t;
+}
+
+constexpr TabelaPrecedencia precedencia = montaPrecedencia();
+
+// Aninhamento padrao de comandos e parenteses (--max-profundidade). Cada nivel gasta
+// pilha nativa no parser e na geracao de codigo: ~330 bytes com -O2 e ~700 sem
+// otimizacao (medido com 1M de '(', begin e if). Com a pilha de 8 MB isso estoura
+// perto de 25000 e 11000 niveis; o maximo aceito deixa o dobro de folga
+constexpr uint32_t PROFUNDIDADE_PADRAO = 2000;
+constexpr uint32_t PROFUNDIDADE_MAXIMA = 5000;
+
+class Sintatico {
+public:
+    // Fronteiras entre os comandos do corpo do programa. Entre dois comandos o unico
+    // estado do parser e a tabela de simbolos, entao a analise pode recomecar em
+    // qualquer fronteira (reanalise incremental)
+    struct Retomada {
+        TabelaSimbolos tabela;               // declaracoes vistas pelo corpo
+        vector<uint64_t> tokens;             // inicio de cada comando; o ultimo e onde a lista acabou
+        vector<size_t> errosSint, errosSem;  // erros ja emitidos em cada fronteira
+        bool corpo = false;                  // a analise chegou ao corpo
+    };
+
+private:
+    FluxoTokens& fluxo;
+    const Fonte& fonte;
+    Internador& nomes;
+    Diagnosticos errosSintaticos;
+    Diagnosticos errosSemanticos;
+    TabelaSimbolos tabelaSimbolos;
+    Arvore& arvore;
+    Retomada* retomada = nullptr;
+    function<bool(uint64_t)> parada; // reanalise: para na primeira fronteira aceita
+    uint64_t primeiroToken = 0;      // indice global do primeiro token do fluxo
+    bool parou = false;
+    Medidor* medidor = nullptr;
+    uint32_t profundidade = 0;       // comandos e parenteses abertos
+    uint32_t limiteProfundidade = PROFUNDIDADE_PADRAO;
+
+    Simbolo atual() {
+        return fluxo.atual();
+    }
+
+    // listaIds tambem guarda tokens que nao sao identificadores; esses ganham id aqui
+    Simbolo comId(Simbolo s) {
+        if (s.id == SEM_ID) s.id = nomes.id(fonte.lexema(s));
+        return s;
+    }
+
+    void avanca() {
+        fluxo.avanca();
+    }
+
+    void sincroniza() {
+        registra(medidor, C_SINCRONIZA);
+        avanca();
+        while (atual().tipo != TK_EOF) {
+            if (atual().sub == OP_PONTO_VIRGULA) {
+                return;
+            }
+            Sub sub = atual().sub;
+            if (sub == PR_IF || sub == PR_WHILE || sub == PR_READ ||
+                sub == PR_WRITE || sub == PR_BEGIN || sub == PR_VAR ||
+                sub == PR_END || atual().tipo == TK_IDENTIFICADOR) {
+                return;
+            }
+            avanca();
+        }
+    }
+
+    bool casa(Sub esperado) {
+        return casa(atual().sub == esperado, textoSub[esperado], "lexema");
+    }
+
+    // Entra num nivel de aninhamento. Passar do limite gera um erro, e quem chamou pula
+    // o trecho aninhado sem recursao em vez de estourar a pilha nativa
+    bool aprofunda() {
+        if (profundidade < limiteProfundidade) {
+            profundidade++;
+            return true;
+        }
+        errosSintaticos.emite(S_PROFUNDIDADE, atual().linha, atual().coluna, {to_string(limiteProfundidade)});
+        return false;
+    }
+
+    // Pula um comando com os begin/end dele; para no ';' ou 'end' que o encerram
+    void pulaComando() {
+        uint64_t nivel = 0;
+        while (atual().tipo != TK_EOF) {
+            Sub sub = atual().sub;
+            if (sub == PR_BEGIN) {
+                nivel++;
+            } else if (sub == PR_END) {
+                if (nivel == 0) return;
+                nivel--;
+            } else if (sub == OP_PONTO_VIRGULA && nivel == 0) {
+                return;
+            }
+            avanca();
+        }
+    }
+
+    // Pula '(' ... ')' balanceados; um ';' ou 'end' antes do fechamento tambem para
+    void pulaParenteses() {
+        uint64_t nivel = 0;
+        while (atual().tipo != TK_EOF && atual().sub != OP_PONTO_VIRGULA && atual().sub != PR_END) {
+            if (atual().sub == OP_ABRE_PAR) {
+                nivel++;
+            } else if (atual().sub == OP_FECHA_PAR && --nivel == 0) {
+                avanca();
+                return;
+            }
+            avanca();
+        }
+    }
+
+    bool casaIdentificador() {
+        return casa(atual().tipo == TK_IDENTIFICADOR, nomeTipoToken[TK_IDENTIFICADOR], "tipo");
+    }
+
+    bool casa(bool casou, const char* esperado, const char* tipoEsperadoStr) {
+        if (atual().tipo == TK_EOF) {
+            errosSintaticos.emite(S_FIM_INESPERADO, fluxo.fim().linha, 0, {esperado});
+            return false;
+        }
+        if (casou) {
+            avanca();
+            return true;
+        } else {
+            Simbolo tok = atual();
+            errosSintaticos.emite(S_ESPERAVA, tok.linha, tok.coluna, {tipoEsperadoStr, esperado, fonte.lexema(tok)});
+            return false;
+        }
+    }
+
+    // Declaracao visivel do id, ou nullptr com o erro de variavel nao declarada
+    const TabelaSimbolos::Declaracao* estaDeclarada(uint32_t id, uint64_t linha, uint32_t coluna) {
+        MedeFase fase(medidor, F_SEMANTICO);
+        registra(medidor, C_BUSCAS);
+        const TabelaSimbolos::Declaracao* decl = tabelaSimbolos.busca(id);
+        if (!decl) {
+            errosSemanticos.emite(M_NAO_DECLARADA, linha, coluna, {nomes.nome(id)});
+        }
+        return decl;
+    }
+
+    bool declararVariavel(uint32_t id, Tipo tipo, uint64_t linha, uint32_t coluna) {
+        MedeFase fase(medidor, F_SEMANTICO);
+        registra(medidor, C_BUSCAS);
+        if (!tabelaSimbolos.declara(id, tipo)) {
+            errosSemanticos.emite(M_REDECLARACAO, linha, coluna, {nomes.nome(id)});
+            return false;
+        }
+        return true;
+    }
+
+    // Cria um no sem filhos para o token e devolve o indice dele
+    uint32_t novoNo(ClasseNo classe, const Simbolo& tok, Tipo tipo = T_DESCONHECIDO) {
+        return arvore.nos.novo({tok.inicio, tok.linha, tok.tamanho, tok.id, SEM_NO, SEM_NO, tipo, classe, tok.sub});
+    }
+
+    uint32_t novoNo(ClasseNo classe, const Simbolo& tok, uint32_t esq, uint32_t dir, Tipo tipo) {
+        uint32_t no = novoNo(classe, tok, tipo);
+        arvore.nos[no].filho = esq;
+        if (dir != SEM_NO) arvore.nos[esq].prox = dir;
+        return no;
+    }
+
+    Tipo tipoDe(uint32_t no) const {
+        return arvore.nos[no].tipo;
+    }
+
+    uint32_t prog() {
+        uint32_t no = novoNo(N_PROGRAMA, atual());
+        if (!casa(PR_PROGRAM)) {
+            sincroniza();
+        }
+        arvore.nos[no].id = atual().tipo == TK_IDENTIFICADOR ? atual().id : SEM_ID;
+        if (!casaIdentificador()) {
+            sincroniza();
+        }
+        if (!casa(OP_PONTO_VIRGULA)) {
+            sincroniza();
+        }
+        arvore.nos[no].filho = bloco();
+        casa(OP_PONTO);
+        if (atual().tipo != TK_EOF) {
+            errosSintaticos.emite(S_ADICIONAIS, atual().linha, atual().coluna);
+        }
+        return no;
+    }
+
+    // Cada bloco abre um escopo; procedures e functions vao aninhar blocos
+    uint32_t bloco() {
+        uint32_t no = novoNo(N_BLOCO, atual());
+        tabelaSimbolos.entraEscopo();
+        uint32_t decl = atual().sub == PR_VAR ? declVar() : novoNo(N_DECLARACOES, atual());
+        uint32_t cmds = novoNo(N_COMPOSTO, atual());
+        if (!casa(PR_BEGIN)) {
+            sincroniza();
+        }
+        bool principal = retomada && !retomada->corpo;
+        if (principal) {
+            retomada->tabela = tabelaSimbolos;
+            retomada->corpo = true;
+        }
+        arvore.nos[cmds].filho = listaComandos(principal);
+        casa(PR_END);
+        tabelaSimbolos.saiEscopo();
+        arvore.nos[no].filho = decl;
+        arvore.nos[decl].prox = cmds;
+        return no;
+    }
+
+    uint32_t declVar() {
+        uint32_t no = novoNo(N_DECLARACOES, atual());
+        uint32_t ultimo = SEM_NO;
+        casa(PR_VAR);
+        while (atual().sub != PR_BEGIN && atual().tipo != TK_EOF) {
+            if (atual().tipo != TK_IDENTIFICADOR) {
+                errosSintaticos.emite(S_ID_DECLARACAO, atual().linha, atual().coluna);
+                sincroniza();
+                if (atual().sub == PR_BEGIN || atual().tipo == TK_EOF) break;
+                continue;
+            }
+            vector<Simbolo> ids;
+            listaIds(ids);
+            if (!casa(OP_DOIS_PONTOS)) {
+                if (atual().sub == PR_INTEGER || atual().sub == PR_BOOLEAN || atual().sub == PR_DOUBLE) {
+                    Simbolo tok = atual();
+                    errosSintaticos.emite(S_DOIS_PONTOS, tok.linha, tok.coluna, {fonte.lexema(tok)});
+                } else {
+                    sincroniza();
+                    if (atual().sub == PR_BEGIN || atual().tipo == TK_EOF) break;
+                    continue;
+                }
+            }
+            Tipo tipo;
+            if (!this->tipo(tipo)) {
+                sincroniza();
+                if (atual().sub == PR_BEGIN || atual().tipo == TK_EOF) break;
+                continue;
+            }
+            for (const Simbolo& id : ids) {
+                if (declararVariavel(id.id, tipo, fluxo.anterior().linha, id.coluna)) {
+                    arvore.anexa(no, ultimo, novoNo(N_DECLARACAO, id, tipo));
+                }
+            }
+            if (!casa(OP_PONTO_VIRGULA)) {
+                if (atual().sub == PR_BEGIN || atual().tipo == TK_IDENTIFICADOR) {
+                    Simbolo ant = fluxo.anterior();
+                    errosSintaticos.emite(S_PV_DECLARACAO, ant.linha, ant.coluna + ant.tamanho);
+                } else {
+                    sincroniza();
+                }
+            }
+        }
+        return no;
+    }
+
+    void listaIds(vector<Simbolo>& ids) {
+        ids.push_back(comId(atual()));
+        casaIdentificador();
+        while (atual().sub == OP_VIRGULA) {
+            avanca();
+            ids.push_back(comId(atual()));
+            casaIdentificador();
+        }
+    }
+
+    bool tipo(Tipo& tipoRet) {
+        Sub sub = atual().sub;
+        if (sub == PR_INTEGER || sub == PR_BOOLEAN || sub == PR_DOUBLE) {
+            tipoRet = sub == PR_INTEGER ? T_INTEGER : sub == PR_DOUBLE ? T_DOUBLE : T_BOOLEAN;
+            avanca();
+            return true;
+        }
+        Simbolo tok = atual();
+        errosSintaticos.emite(S_ESPERAVA_TIPO, tok.linha, tok.coluna, {fonte.lexema(tok)});
+        return false;
+    }
+
+    // Registra uma fronteira do corpo; devolve true se a reanalise deve parar nela
+    // (nunca na primeira, onde ela comecou)
+    bool fronteira() {
+        uint64_t pos = primeiroToken + fluxo.posicao();
+        retomada->tokens.push_back(pos);
+        retomada->errosSint.push_back(errosSintaticos.tamanho());
+        retomada->errosSem.push_back(errosSemanticos.tamanho());
+        return retomada->tokens.size() > 1 && parada && parada(pos);
+    }
+
+    // Devolve o primeiro comando da lista; os demais seguem por 'prox'.
+    // A lista do corpo do programa ('principal') marca as fronteiras dos comandos
+    uint32_t listaComandos(bool principal = false) {
+        uint32_t primeiro = SEM_NO, ultimo = SEM_NO;
+        while (atual().sub != PR_END && atual().tipo != TK_EOF) {
+            if (principal && fronteira()) {
+                parou = true;
+                return primeiro;
+            }
+            uint64_t linhaAnterior = atual().linha;
+            uint32_t colunaAnterior = atual().coluna;
+            uint32_t cmd = comando();
+            if (ultimo == SEM_NO) primeiro = cmd;
+            else arvore.nos[ultimo].prox = cmd;
+            ultimo = cmd;
+            if (atual().sub == PR_END) {
+                break;
+            }
+            if (atual().sub != OP_PONTO_VIRGULA) {
+                if (atual().sub != PR_END && atual().tipo != TK_EOF) {
+                    errosSintaticos.emite(S_PV_INSTRUCAO, linhaAnterior, colunaAnterior);
+                    sincroniza();
+                }
+            } else {
+                avanca();
+            }
+        }
+        if (principal) fronteira();
+        return primeiro;
+    }
+
+    uint32_t comando() {
+        if (!aprofunda()) {
+            uint32_t no = novoNo(N_ERRO, atual());
+            pulaComando();
+            return no;
+        }
+        uint32_t no = comandoAninhado();
+        profundidade--;
+        return no;
+    }
+
+    uint32_t comandoAninhado() {
+        if (atual().tipo == TK_IDENTIFICADOR) {
+            return atribuicao();
+        }
+        switch (atual().sub) {
+            case PR_READ: return leitura();
+            case PR_WRITE: return escrita();
+            case PR_IF: return se();
+            case PR_WHILE: return enquanto();
+            case PR_BEGIN: return blocoInicioFim();
+            default: {
+                uint32_t no = novoNo(N_ERRO, atual());
+                errosSintaticos.emite(S_COMANDO, atual().linha, atual().coluna, {fonte.lexema(atual())});
+                sincroniza();
+                return no;
+            }
+        }
+    }
+
+    uint32_t atribuicao() {
+        Simbolo destino = atual();
+        uint32_t id = destino.id;
+        uint64_t linha = destino.linha;
+        const TabelaSimbolos::Declaracao* decl = estaDeclarada(id, linha, destino.coluna);
+        Tipo tipoId = decl ? decl->tipo : T_DESCONHECIDO;
+        casaIdentificador();
+        if (atual().sub == OP_ATRIB) {
+            avanca();
+            uint32_t exp = expressao();
+            MedeFase fase(medidor, F_SEMANTICO);
+            Tipo tipoExp = tipoDe(exp);
+            if (regrasTipo(OP_ATRIB, tipoId, tipoExp).erro != NUM_DIAG) {
+                errosSemanticos.emite(M_ATRIBUICAO, linha, destino.coluna, {nomeTipo[tipoExp], nomes.nome(id), nomeTipo[tipoId]});
+            }
+            return novoNo(N_ATRIBUICAO, destino, exp, SEM_NO, tipoId);
+        } else if (atual().sub == OP_IGUAL) {
+            Simbolo igual = atual();
+            avanca();
+            errosSintaticos.emite(S_ATRIB_IGUAL, igual.linha, igual.coluna);
+            return novoNo(N_ERRO, destino, expressao(), SEM_NO, T_DESCONHECIDO);
+        } else {
+            sincroniza();
+            return novoNo(N_ERRO, destino);
+        }
+    }
+
+    uint32_t leitura() {
+        uint32_t no = novoNo(N_LEITURA, atual());
+        uint32_t ultimo = SEM_NO;
+        casa(PR_READ);
+        casa(OP_ABRE_PAR);
+        vector<Simbolo> ids;
+        listaIds(ids);
+        for (const Simbolo& id : ids) {
+            const TabelaSimbolos::Declaracao* decl = estaDeclarada(id.id, fluxo.anterior().linha, id.coluna);
+            arvore.anexa(no, ultimo, novoNo(N_VARIAVEL, id, decl ? decl->tipo : T_DESCONHECIDO));
+        }
+        casa(OP_FECHA_PAR);
+        return no;
+    }
+
+    uint32_t escrita() {
+        uint32_t no = novoNo(N_ESCRITA, atual());
+        casa(PR_WRITE);
+        casa(OP_ABRE_PAR);
+        arvore.nos[no].filho = listaExp();
+        casa(OP_FECHA_PAR);
+        return no;
+    }
+
+    uint32_t se() {
+        uint32_t no = novoNo(N_SE, atual());
+        uint32_t ultimo = SEM_NO;
+        casa(PR_IF);
+        uint32_t cond = expressao();
+        arvore.anexa(no, ultimo, cond);
+        Tipo tipoExp = tipoDe(cond);
+        if (regrasTipo(PR_IF, tipoExp, T_BOOLEAN).erro != NUM_DIAG) {
+            errosSemanticos.emite(M_IF, atual().linha, atual().coluna, {nomeTipo[tipoExp]});
+        }
+        if (!casa(PR_THEN)) {
+        }
+        arvore.anexa(no, ultimo, comando());
+        if (atual().sub == PR_ELSE) {
+            avanca();
+            arvore.anexa(no, ultimo, comando());
+        }
+        return no;
+    }
+
+    uint32_t enquanto() {
+        uint32_t no = novoNo(N_ENQUANTO, atual());
+        uint32_t ultimo = SEM_NO;
+        casa(PR_WHILE);
+        uint32_t cond = expressao();
+        arvore.anexa(no, ultimo, cond);
+        Tipo tipoExp = tipoDe(cond);
+        if (regrasTipo(PR_WHILE, tipoExp, T_BOOLEAN).erro != NUM_DIAG) {
+            errosSemanticos.emite(M_WHILE, atual().linha, atual().coluna, {nomeTipo[tipoExp]});
+        }
+        if (!casa(PR_DO)) {
+            arvore.anexa(no, ultimo, novoNo(N_ERRO, atual()));
+            sincroniza();
+        } else {
+            arvore.anexa(no, ultimo, comando());
+        }
+        return no;
+    }
+
+    uint32_t blocoInicioFim() {
+        uint32_t no = novoNo(N_COMPOSTO, atual());
+        casa(PR_BEGIN);
+        arvore.nos[no].filho = listaComandos();
+        casa(PR_END);
+        return no;
+    }
+
+    // Devolve a primeira expressao; as demais seguem por 'prox'
+    uint32_t listaExp() {
+        uint32_t primeiro = expressao(), ultimo = primeiro;
+        while (atual().sub == OP_VIRGULA) {
+            avanca();
+            uint32_t exp = expressao();
+            arvore.nos[ultimo].prox = exp;
+            ultimo = exp;
+        }
+        return primeiro;
+    }
+
+    // Expressoes sao analisadas uma vez so, por precedence climbing: um laco so para todos
+    // os operadores binarios, e o operando direito de um operador de precedencia p e lido
+    // com minimo p + 1. Cada no e montado e tem os tipos conferidos na hora
+    uint32_t expressao(unsigned minimo = PREC_RELACIONAL) {
+        uint32_t no = fator();
+        while (precedencia.de[atual().sub] >= minimo) {
+            Simbolo op = atual();
+            avanca();
+            uint32_t dir = expressao(precedencia.de[op.sub] + 1u);
+            no = binario(op, no, dir);
+        }
+        return no;
+    }
+
+    // Tipo do no e erro, se houver, saem da tabela de regras. 'or' e 'and' nao levam
+    // o operador nos argumentos da mensagem
+    uint32_t binario(const Simbolo& op, uint32_t esq, uint32_t dir) {
+        Tipo tipo = tipoDe(esq), tipo2 = tipoDe(dir);
+        const RegraTipo& regra = regrasTipo(op.sub, tipo, tipo2);
+        if (regra.erro != NUM_DIAG) {
+            MedeFase fase(medidor, F_SEMANTICO);
+            if (regra.erro == M_OR || regra.erro == M_AND) {
+                errosSemanticos.emite(regra.erro, op.linha, op.coluna, {nomeTipo[tipo], nomeTipo[tipo2]});
+            } else {
+                errosSemanticos.emite(regra.erro, op.linha, op.coluna, {textoSub[op.sub], nomeTipo[tipo], nomeTipo[tipo2]});
+            }
+        }
+        return novoNo(N_BINARIO, op, esq, dir, regra.resultado);
+    }
+
+    // O literal tem so digitos; compara com INT64_MAX sem acumular (acumular daria a volta)
+    static bool cabeEmInteiro(string_view lex) {
+        static constexpr string_view maximo = "9223372036854775807";
+        size_t i = 0;
+        while (i + 1 < lex.size() && lex[i] == '0') i++;
+        lex.remove_prefix(i);
+        return lex.size() < maximo.size() || (lex.size() == maximo.size() && lex <= maximo);
+    }
+
+    uint32_t fator() {
+        Simbolo tok = atual();
+        TipoToken t = tok.tipo;
+
+        if (t == TK_IDENTIFICADOR) {
+            avanca();
+            const TabelaSimbolos::Declaracao* decl = estaDeclarada(tok.id, tok.linha, tok.coluna);
+            return novoNo(N_VARIAVEL, tok, decl ? decl->tipo : T_DESCONHECIDO);
+        } else if (t == TK_NUM_INTEIRO) {
+            avanca();
+            if (!cabeEmInteiro(fonte.lexema(tok))) {
+                errosSemanticos.emite(M_INTEIRO_GRANDE, tok.linha, tok.coluna, {fonte.lexema(tok)});
+                return novoNo(N_INTEIRO, tok, T_DESCONHECIDO);
+            }
+            return novoNo(N_INTEIRO, tok, T_INTEGER);
+        } else if (t == TK_NUM_REAL) {
+            avanca();
+            return novoNo(N_REAL, tok, T_DOUBLE);
+        } else if (t == TK_STRING) {
+            avanca();
+            return novoNo(N_STRING, tok, T_STRING);
+        } else if (tok.sub == PR_TRUE || tok.sub == PR_FALSE) {
+            avanca();
+            return novoNo(N_BOOLEANO, tok, T_BOOLEAN);
+        } else if (tok.sub == OP_ABRE_PAR) {
+            if (!aprofunda()) {
+                pulaParenteses();
+                return novoNo(N_ERRO, tok);
+            }
+            avanca();
+            uint32_t no = expressao();
+            casa(OP_FECHA_PAR);
+            profundidade--;
+            return no;
+        } else if (tok.sub == PR_NOT) {
+            // 'not not ... x' sem recursao: os 'not' sao aplicados de dentro para fora
+            vector<Simbolo> nots;
+            while (atual().sub == PR_NOT) {
+                nots.push_back(atual());
+                avanca();
+            }
+            uint32_t no = fator();
+            for (size_t k = nots.size(); k-- > 0;) {
+                Tipo tipo = tipoDe(no);
+                if (regrasTipo(PR_NOT, tipo, T_BOOLEAN).erro != NUM_DIAG) {
+                    errosSemanticos.emite(M_NOT, nots[k].linha, nots[k].coluna, {nomeTipo[tipo]});
+                }
+                no = novoNo(N_UNARIO, nots[k], no, SEM_NO, T_BOOLEAN);
+            }
+            return no;
+        } else if (t == TK_ERRO_LEXICO) {
+            avanca();
+            return novoNo(N_ERRO, tok);
+        } else {
+            errosSintaticos.emite(S_TOKEN_INESPERADO, tok.linha, tok.coluna, {fonte.lexema(tok)});
+            sincroniza();
+            return novoNo(N_ERRO, tok);
+        }
+    }
+
+public:
+    Sintatico(FluxoTokens& f, const Fonte& fon, Internador& n, Arvore& a) : fluxo(f), fonte(fon), nomes(n), arvore(a) {}
+
+    // Mede a analise, as conferencias de tipo e as buscas na tabela em 'm' (nulo desliga)
+    void instrumenta(Medidor* m) { medidor = m; }
+
+    // Monta a arvore do programa em 'arvore' (raiz fica SEM_NO se nao ha tokens).
+    // Com 'r', registra as fronteiras dos comandos do corpo
+    void analisar(Retomada* r = nullptr) {
+        MedeFase fase(medidor, F_SINTATICO);
+        retomada = r;
+        if (fluxo.vazio()) {
+            errosSintaticos.emite(S_SEM_TOKENS, 0, 0);
+            return;
+        }
+        arvore.raiz = prog();
+    }
+
+    // Reanalisa comandos do corpo desde o inicio do fluxo, que e o token 'primeiro'
+    // do programa, com as declaracoes de 'r.tabela'. Para na primeira fronteira
+    // aceita por 'para' (devolve true) ou no fim do corpo
+    bool reanalisaCorpo(Retomada& r, uint64_t primeiro, function<bool(uint64_t)> para) {
+        retomada = &r;
+        tabelaSimbolos = r.tabela;
+        primeiroToken = primeiro;
+        parada = move(para);
+        r.corpo = true;
+        listaComandos(true);
+        return parou;
+    }
+
+    const Diagnosticos& getErrosSintaticos() const {
+        return errosSintaticos;
+    }
+    const Diagnosticos& getErrosSemanticos() const {
+        return errosSemanticos;
+    }
+    const TabelaSimbolos& getTabelaSimbolos() const {
+        return tabelaSimbolos;
+    }
+
+    void configuraErros(const LimiteDiag& limite) {
+        errosSintaticos.configura(limite);
+        errosSemanticos.configura(limite);
+    }
+
+    // Maximo de comandos e parenteses aninhados (--max-profundidade)
+    void limitaProfundidade(uint32_t n) {
+        limiteProfundidade = n;
+    }
+};
+
+// Documento aberto num editor. Guarda por linha os tokens, os erros lexicos e o
+// estado de comentario no fim dela, e por comando do corpo do programa os erros da
+// analise. Uma edicao rele so as linhas trocadas (e as seguintes cujo comentario
+// mudou de estado) e reanalisa so os comandos que tocam nelas; o cabecalho com as
+// declaracoes e o fim do programa, quando mudam, sao reanalisados junto com o resto
+class Documento {
+    // Os erros guardam a linha relativa (a da propria linha ou a da unidade), que
+    // continua valendo quando edicoes acima deslocam o texto
+    struct Linha {
+        string texto;
+        string reescritos;
+        vector<Simbolo> tokens; // inicio relativo a linha; reescritos depois de texto.size()
+        Diagnosticos erros;     // erros lexicos, na linha 0
+        bool comentEntrada = false;
+        bool comentSaida = false;
+    };
+
+    // Pedaco da analise: o cabecalho (ate o 'begin' do corpo), cada comando do corpo
+    // e o fim do programa. Comeca num token e vai ate o inicio da seguinte
+    struct Unidade {
+        uint64_t token;
+        uint64_t linha; // linha (a partir de 0) do primeiro token
+        Diagnosticos sint, sem; // linhas relativas a do primeiro token
+    };
+
+    static constexpr size_t FOLGA_UNIDADES = 4; // comandos lidos alem dos afetados
+
+    Internador nomes{true};
+    vector<Linha> linhas;
+    vector<uint64_t> tokensAntes{0}; // tokens nas linhas anteriores a cada linha
+    vector<Unidade> unidades;
+    TabelaSimbolos tabelaCorpo;
+    bool estruturado = false; // achou o corpo do programa e suas fronteiras
+
+public:
+    struct Estatisticas {
+        uint64_t linhasRelidas = 0;
+        uint64_t tokensReanalisados = 0;
+        bool completa = false; // reanalisou o programa inteiro
+    };
+
+private:
+    Estatisticas ultima;
+
+    // Le as linhas [de, ate), cada uma como um trecho, a partir do estado de comentario da anterior
+    void lexLinhas(size_t de, size_t ate) {
+        string texto;
+        for (size_t k = de; k < ate; k++) {
+            texto += linhas[k].texto;
+            texto += '\n';
+        }
+        Fonte fonte;
+        fonte.carrega(move(texto));
+        uint64_t tam = fonte.texto().size();
+
+        bool coment = de > 0 && linhas[de - 1].comentSaida;
+        uint64_t inicio = 0;
+        Lexico::Trecho t;
+        vector<uint32_t> mapa;
+        for (size_t k = de; k < ate; k++) {
+            Linha& l = linhas[k];
+            t.inicio = inicio;
+            t.fim = inicio + l.texto.size() + 1;
+            t.linhaBase = k;
+            t.comentInicial = coment;
+            Lexico::lexTrecho(fonte, t);
+
+            mapa.resize(t.nomes.tamanho());
+            for (uint32_t j = 0; j < mapa.size(); j++) mapa[j] = nomes.id(t.nomes.nome(j));
+            for (Simbolo& simb : t.tokens) {
+                if (simb.id != SEM_ID) simb.id = mapa[simb.id];
+                simb.inicio = simb.inicio < tam ? simb.inicio - inicio : l.texto.size() + (simb.inicio - tam);
+            }
+            l.tokens.swap(t.tokens);
+            l.reescritos.swap(t.reescritos);
+            l.erros = Diagnosticos();
+            l.erros.anexa(t.erros, -(int64_t)(k + 1));
+            l.comentEntrada = coment;
+            l.comentSaida = coment = t.comentFinal;
+            inicio = t.fim;
+        }
+        ultima.linhasRelidas += ate - de;
+    }
+
+    void contaTokens() {
+        tokensAntes.resize(linhas.size() + 1);
+        for (size_t k = 0; k < linhas.size(); k++) tokensAntes[k + 1] = tokensAntes[k] + linhas[k].tokens.size();
+    }
+
+    uint64_t totalTokens() const {
+        return tokensAntes.back();
+    }
+
+    // Linha do token; o fim dos tokens fica na ultima linha
+    uint64_t linhaDoToken(uint64_t tok) const {
+        size_t k = upper_bound(tokensAntes.begin(), tokensAntes.end(), tok) - tokensAntes.begin();
+        return k >= 2 ? min<uint64_t>(k - 1, linhas.size() - 1) : 0;
+    }
+
+    // Tokens [de, ate) com lexemas numa Fonte montada so com as linhas deles
+    vector<Simbolo> materializa(uint64_t de, uint64_t ate, Fonte& fonte) const {
+        vector<Simbolo> tokens;
+        if (de >= ate) {
+            fonte.carrega("");
+            return tokens;
+        }
+        uint64_t primeira = linhaDoToken(de), ultimaLinha = linhaDoToken(ate - 1);
+        string texto;
+        vector<uint64_t> inicio;
+        for (uint64_t k = primeira; k <= ultimaLinha; k++) {
+            inicio.push_back(texto.size());
+            texto += linhas[k].texto;
+            texto += '\n';
+        }
+        fonte.carrega(move(texto));
+        tokens.reserve(ate - de);
+        for (uint64_t k = primeira; k <= ultimaLinha; k++) {
+            const Linha& l = linhas[k];
+            uint64_t j0 = de > tokensAntes[k] ? de - tokensAntes[k] : 0;
+            uint64_t j1 = min<uint64_t>(l.tokens.size(), ate - tokensAntes[k]);
+            for (uint64_t j = j0; j < j1; j++) {
+                Simbolo simb = l.tokens[j];
+                simb.linha = k + 1;
+                if (simb.inicio < l.texto.size()) simb.inicio += inicio[k - primeira];
+                else simb.inicio = fonte.guarda(string_view(l.reescritos).substr(simb.inicio - l.texto.size(), simb.tamanho));
+                tokens.push_back(simb);
+            }
+        }
+        return tokens;
+    }
+
+    Unidade novaUnidade(uint64_t token, const Sintatico& sint, size_t sint0, size_t sint1, size_t sem0, size_t sem1) const {
+        Unidade u{token, linhaDoToken(token), {}, {}};
+        int64_t base = -(int64_t)(u.linha + 1);
+        u.sint.anexa(sint.getErrosSintaticos(), base, sint0, sint1);
+        u.sem.anexa(sint.getErrosSemanticos(), base, sem0, sem1);
+        return u;
+    }
+
+    void analisaTudo() {
+        Fonte fonte;
+        vector<Simbolo> tokens = materializa(0, totalTokens(), fonte);
+        FluxoTokens fluxo(tokens);
+        Arvore arvore;
+        Sintatico sint(fluxo, fonte, nomes, arvore);
+        Sintatico::Retomada r;
+        sint.analisar(&r);
+
+        size_t totalSint = sint.getErrosSintaticos().tamanho(), totalSem = sint.getErrosSemanticos().tamanho();
+        unidades.clear();
+        estruturado = r.corpo;
+        if (!estruturado) {
+            unidades.push_back(novaUnidade(0, sint, 0, totalSint, 0, totalSem));
+        } else {
+            unidades.push_back(novaUnidade(0, sint, 0, r.errosSint[0], 0, r.errosSem[0]));
+            for (size_t k = 0; k < r.tokens.size(); k++) {
+                bool fim = k + 1 == r.tokens.size();
+                unidades.push_back(novaUnidade(r.tokens[k], sint, r.errosSint[k], fim ? totalSint : r.errosSint[k + 1],
+                                               r.errosSem[k], fim ? totalSem : r.errosSem[k + 1]));
+            }
+            tabelaCorpo = move(r.tabela);
+        }
+        ultima.completa = true;
+        ultima.tokensReanalisados = tokens.size();
+    }
+
+    size_t unidadeDe(uint64_t tok) const {
+        auto it = upper_bound(unidades.begin(), unidades.end(), tok, [](uint64_t t, const Unidade& u) { return t < u.token; });
+        return it == unidades.begin() ? 0 : (size_t)(it - unidades.begin()) - 1;
+    }
+
+    // Os tokens [t0, t1) viraram [t0, t1 + delta) e as linhas depois deles andaram 'deltaLinhas'.
+    // Reanalisa a partir do comando que contem o token antes de t0 ate alcancar o inicio de um
+    // comando antigo depois de t1: dali em diante a analise seria a mesma
+    void reanalisa(uint64_t t0, uint64_t t1, int64_t delta, int64_t deltaLinhas) {
+        if (!estruturado) return analisaTudo();
+        size_t fimCorpo = unidades.size() - 1;
+        size_t u1 = unidadeDe(t0 > 0 ? t0 - 1 : 0), u2 = unidadeDe(t1);
+        if (u1 == 0 || u2 >= fimCorpo) return analisaTudo();
+
+        auto deslocado = [&](size_t k) { return (uint64_t)((int64_t)unidades[k].token + delta); };
+        auto retomaEm = [&](uint64_t pos) -> size_t {
+            size_t lo = u2 + 1, hi = fimCorpo + 1;
+            while (lo < hi) {
+                size_t m = (lo + hi) / 2;
+                if (deslocado(m) < pos) lo = m + 1;
+                else hi = m;
+            }
+            return lo <= fimCorpo && deslocado(lo) == pos ? lo : SIZE_MAX;
+        };
+
+        uint64_t inicio = unidades[u1].token;
+        uint64_t ate = min<uint64_t>(totalTokens(), deslocado(min(fimCorpo, u2 + 1 + FOLGA_UNIDADES)) + 1);
+        Fonte fonte;
+        vector<Simbolo> tokens = materializa(inicio, ate, fonte);
+        FluxoTokens fluxo(tokens);
+        Arvore arvore;
+        Sintatico sint(fluxo, fonte, nomes, arvore);
+        Sintatico::Retomada r;
+        r.tabela = tabelaCorpo;
+        bool parou = sint.reanalisaCorpo(r, inicio, [&](uint64_t pos) { return retomaEm(pos) != SIZE_MAX; });
+        if (fluxo.esgotado()) return analisaTudo();
+        size_t j = retomaEm(r.tokens.back());
+        if (j == SIZE_MAX || (!parou && j != fimCorpo)) return analisaTudo();
+
+        for (size_t k = j; k <= fimCorpo; k++) {
+            unidades[k].token = deslocado(k);
+            unidades[k].linha = (uint64_t)((int64_t)unidades[k].linha + deltaLinhas);
+        }
+        vector<Unidade> novas;
+        for (size_t k = 0; k + 1 < r.tokens.size(); k++) {
+            novas.push_back(novaUnidade(r.tokens[k], sint, r.errosSint[k], r.errosSint[k + 1], r.errosSem[k], r.errosSem[k + 1]));
+        }
+        unidades.erase(unidades.begin() + u1, unidades.begin() + j);
+        unidades.insert(unidades.begin() + u1, make_move_iterator(novas.begin()), make_move_iterator(novas.end()));
+        ultima.tokensReanalisados = r.tokens.back() - inicio;
+    }
+
+    Diagnosticos junta(Diagnosticos Unidade::*lista) const {
+        Diagnosticos erros;
+        for (const Unidade& u : unidades) erros.anexa(u.*lista, (int64_t)u.linha + 1);
+        return erros;
+    }
+
+    // Um '\n' no fim nao abre outra linha, como no lexico
+    static vector<string_view> divideLinhas(string_view texto) {
+        vector<string_view> r;
+        size_t inicio = 0;
+        while (inicio < texto.size()) {
+            size_t nl = texto.find('\n', inicio);
+            if (nl == string_view::npos) nl = texto.size();
+            r.push_back(texto.substr(inicio, nl - inicio));
+            inicio = nl + 1;
+        }
+        return r;
+    }
+
+public:
+    // Texto inteiro
+    void carrega(string_view texto) {
+        linhas.clear();
+        for (string_view l : divideLinhas(texto)) {
+            linhas.emplace_back();
+            linhas.back().texto.assign(l);
+        }
+        ultima = Estatisticas();
+        lexLinhas(0, linhas.size());
+        contaTokens();
+        analisaTudo();
+    }
+
+    bool abrir(const string& arquivo) {
+        Fonte fonte;
+        if (!fonte.abrir(arquivo)) return false;
+        carrega(fonte.texto());
+        return true;
+    }
+
+    // Troca 'removidas' linhas a partir de 'inicio' (a partir de 0) por 'novas'
+    void edita(size_t inicio, size_t removidas, const vector<string>& novas) {
+        ultima = Estatisticas();
+        inicio = min(inicio, linhas.size());
+        removidas = min(removidas, linhas.size() - inicio);
+        uint64_t t0 = tokensAntes[inicio], t1 = tokensAntes[inicio + removidas];
+
+        size_t comuns = min(removidas, novas.size());
+        for (size_t k = 0; k < comuns; k++) linhas[inicio + k].texto = novas[k];
+        if (removidas > comuns) {
+            linhas.erase(linhas.begin() + inicio + comuns, linhas.begin() + inicio + removidas);
+        } else if (novas.size() > comuns) {
+            vector<Linha> inseridas(novas.size() - comuns);
+            for (size_t k = comuns; k < novas.size(); k++) inseridas[k - comuns].texto = novas[k];
+            linhas.insert(linhas.begin() + inicio + comuns, make_move_iterator(inseridas.begin()), make_move_iterator(inseridas.end()));
+        }
+
+        // Linhas seguintes so sao relidas se o comentario que chega nelas mudou
+        size_t fim = inicio + novas.size();
+        lexLinhas(inicio, fim);
+        auto mudou = [&] { return fim < linhas.size() && linhas[fim].comentEntrada != (fim > 0 && linhas[fim - 1].comentSaida); };
+        for (size_t lote = 16; mudou(); lote *= 2) {
+            size_t ate = min(linhas.size(), fim + lote);
+            for (size_t k = fim; k < ate; k++) t1 += linhas[k].tokens.size();
+            lexLinhas(fim, ate);
+            fim = ate;
+        }
+        contaTokens();
+        int64_t delta = (int64_t)tokensAntes[fim] - (int64_t)t1;
+        reanalisa(t0, t1, delta, (int64_t)novas.size() - (int64_t)removidas);
+    }
+
+    // Troca o texto inteiro por 'texto', editando so as linhas entre o prefixo e o
+    // sufixo que nao mudaram; devolve false se nada mudou
+    bool atualiza(string_view texto) {
+        vector<string_view> novas = divideLinhas(texto);
+        size_t ini = 0, fimNovas = novas.size(), fimAntigas = linhas.size();
+        while (ini < fimNovas && ini < fimAntigas && novas[ini] == linhas[ini].texto) ini++;
+        while (fimNovas > ini && fimAntigas > ini && novas[fimNovas - 1] == linhas[fimAntigas - 1].texto) {
+            fimNovas--;
+            fimAntigas--;
+        }
+        ultima = Estatisticas();
+        if (ini == fimNovas && ini == fimAntigas) return false;
+        edita(ini, fimAntigas - ini, vector<string>(novas.begin() + ini, novas.begin() + fimNovas));
+        return true;
+    }
+
+    // Todos os tokens, com lexemas numa Fonte montada com o texto atual
+    vector<Simbolo> tokens(Fonte& fonte) const {
+        return materializa(0, totalTokens(), fonte);
+    }
+
+    Diagnosticos errosLexicos() const {
+        Diagnosticos erros;
+        for (size_t k = 0; k < linhas.size(); k++) erros.anexa(linhas[k].erros, (int64_t)k + 1);
+        if (!linhas.empty() && linhas.back().comentSaida) erros.emite(L_COMENT_FIM, linhas.size(), 0);
+        return erros;
+    }
+
+    Diagnosticos errosSintaticos() const {
+        return junta(&Unidade::sint);
+    }
+
+    Diagnosticos errosSemanticos() const {
+        return junta(&Unidade::sem);
+    }
+
+    const Estatisticas& getEstatisticas() const {
+        return ultima;
+    }
+
+    size_t numLinhas() const {
+        return linhas.size();
+    }
+
+    uint64_t numTokens() const {
+        return totalTokens();
+    }
+};
+
+// Tipo do valor que uma instrucao manipula
+enum TipoValor : uint8_t { V_INTEGER, V_DOUBLE, V_BOOLEAN, V_STRING };
+
+// Desconhecido nao chega aqui: so se gera codigo sem erros
+constexpr TipoValor valorDoTipo[NUM_TIPOS] = {V_INTEGER, V_INTEGER, V_DOUBLE, V_BOOLEAN, V_STRING};
+
+TipoValor tipoValor(Tipo tipo) {
+    return valorDoTipo[tipo];
+}
+
+enum OpTac : uint8_t {
+    TAC_COPIA,       // dst := src1
+    TAC_SOMA, TAC_SUB, TAC_MUL, TAC_BARRA, TAC_DIV, TAC_MOD,  // dst := src1 op src2
+    TAC_IGUAL, TAC_DIFERENTE, TAC_MENOR, TAC_MAIOR, TAC_MENOR_IGUAL, TAC_MAIOR_IGUAL,
+    TAC_E, TAC_OU,
+    TAC_NAO,         // dst := not src1
+    TAC_PARA_REAL,   // dst := src1 convertido para double
+    TAC_ROTULO,      // dst:
+    TAC_SALTO,       // goto dst
+    TAC_SE_FALSO,    // ifFalse src1 goto dst
+    TAC_LEIA,        // read dst
+    TAC_ESCREVA,     // write src1
+    NUM_OP_TAC
+};
+
+constexpr const char* textoOpTac[NUM_OP_TAC] = {
+    ":=", "+", "-", "*", "/", "div", "mod", "=", "<>", "<", ">", "<=", ">=", "and", "or",
+    "not", "real", "", "goto", "ifFalse", "read", "write"
+};
+
+// Operando de 32 bits: a classe fica nos 2 bits de cima e o indice nos outros.
+// Variaveis usam o id do Internador; temporarios, constantes e rotulos sao numerados
+enum ClasseOperando : uint32_t { OPD_VAR, OPD_TEMP, OPD_CONST, OPD_ROTULO };
+
+constexpr uint32_t SEM_OPD = UINT32_MAX;
+
+constexpr uint32_t operando(ClasseOperando classe, uint32_t indice) {
+    return (uint32_t)classe << 30 | indice;
+}
+constexpr ClasseOperando classeOpd(uint32_t opd) {
+    return (ClasseOperando)(opd >> 30);
+}
+constexpr uint32_t indiceOpd(uint32_t opd) {
+    return opd & 0x3FFFFFFFu;
+}
+
+struct Constante {
+    TipoValor tipo;
+    int64_t inteiro;   // integer e boolean
+    double real;
+    string_view texto; // strings, sem as aspas
+};
+
+// Codigo de tres enderecos em estrutura de arrays: a instrucao i e
+// (op[i], tipo[i], dst[i], src1[i], src2[i]). 'tipo' e o dos operandos
+// (nas relacionais) ou o do resultado (nas outras)
+struct CodigoIntermediario {
+    vector<OpTac> op;
+    vector<TipoValor> tipo;
+    vector<uint32_t> dst;
+    vector<uint32_t> src1;
+    vector<uint32_t> src2;
+    vector<Constante> constantes;
+    uint32_t numTemps = 0;
+    uint32_t numRotulos = 0;
+
+    size_t tamanho() const {
+        return op.size();
+    }
+
+    void emite(OpTac o, TipoValor t, uint32_t d, uint32_t s1 = SEM_OPD, uint32_t s2 = SEM_OPD) {
+        op.push_back(o);
+        tipo.push_back(t);
+        dst.push_back(d);
+        src1.push_back(s1);
+        src2.push_back(s2);
+    }
+
+    uint32_t novoTemp() {
+        return operando(OPD_TEMP, numTemps++);
+    }
+
+    uint32_t novoRotulo() {
+        return operando(OPD_ROTULO, numRotulos++);
+    }
+
+    uint32_t constante(const Constante& c) {
+        constantes.push_back(c);
+        return operando(OPD_CONST, (uint32_t)(constantes.size() - 1));
+    }
+
+    // Tira as instrucoes marcadas, mantendo a ordem das outras
+    void remove(const vector<uint8_t>& morta) {
+        size_t j = 0;
+        for (size_t i = 0; i < op.size(); i++) {
+            if (morta[i]) continue;
+            op[j] = op[i];
+            tipo[j] = tipo[i];
+            dst[j] = dst[i];
+            src1[j] = src1[i];
+            src2[j] = src2[i];
+            j++;
+        }
+        op.resize(j);
+        tipo.resize(j);
+        dst.resize(j);
+        src1.resize(j);
+        src2.resize(j);
+    }
+};
+
+// Traduz a arvore de um programa sem erros para codigo de tres enderecos
+class GeradorIntermediario {
+    const Arvore& arvore;
+    const Fonte& fonte;
+    CodigoIntermediario& codigo;
+    vector<uint32_t> espinha;        // nos da espinha esquerda ainda por aplicar
+
+    const No& no(uint32_t i) const {
+        return arvore.nos[i];
+    }
+
+    string_view texto(const No& n) const {
+        return fonte.lexema(n.inicio, n.tamanho);
+    }
+
+    // Converte para double quando o destino e double e o valor e integer
+    uint32_t converte(uint32_t opd, TipoValor de, TipoValor para) {
+        if (de != V_INTEGER || para != V_DOUBLE) return opd;
+        uint32_t t = codigo.novoTemp();
+        codigo.emite(TAC_PARA_REAL, V_DOUBLE, t, opd);
+        return t;
+    }
+
+    uint32_t literal(const No& n) {
+        Constante c{tipoValor(n.tipo), 0, 0.0, {}};
+        string_view lex = texto(n);
+        if (n.classe == N_INTEIRO) {
+            // o sintatico ja rejeitou (M012) o que nao cabe; satura por garantia
+            uint64_t v = 0;
+            for (char ch : lex) {
+                uint64_t d = (uint64_t)(ch - '0');
+                v = v > (INT64_MAX - d) / 10 ? (uint64_t)INT64_MAX : v * 10 + d;
+            }
+            c.inteiro = (int64_t)v;
+        } else if (n.classe == N_REAL) {
+            c.real = strtod(string(lex).c_str(), nullptr);
+        } else if (n.classe == N_BOOLEANO) {
+            c.inteiro = n.op == PR_TRUE;
+        } else {
+            c.texto = lex.substr(1, lex.size() - 2);
+        }
+        return codigo.constante(c);
+    }
+
+    // A espinha esquerda de uma expressao (a + b + c ..., not not x) e descida com uma
+    // pilha, nao com recursao; so o operando direito recorre, e ele e limitado pelo
+    // aninhamento de parenteses que o parser aceita
+    uint32_t expressao(uint32_t i) {
+        size_t base = espinha.size();
+        while (no(i).classe == N_BINARIO || no(i).classe == N_UNARIO) {
+            espinha.push_back(i);
+            i = no(i).filho;
+        }
+        const No& folha = no(i);
+        uint32_t v = folha.classe == N_VARIAVEL ? operando(OPD_VAR, folha.id) : literal(folha);
+        while (espinha.size() > base) {
+            const No& n = no(espinha.back());
+            espinha.pop_back();
+            v = aplica(n, v);
+        }
+        return v;
+    }
+
+    uint32_t aplica(const No& n, uint32_t a) {
+        if (n.classe == N_UNARIO) {
+            uint32_t t = codigo.novoTemp();
+            codigo.emite(TAC_NAO, V_BOOLEAN, t, a);
+            return t;
+        }
+        const No& esq = no(n.filho);
+        const No& dir = no(esq.prox);
+        uint32_t b = expressao(esq.prox);
+        TipoValor ta = tipoValor(esq.tipo), tb = tipoValor(dir.tipo), tr = tipoValor(n.tipo);
+        OpTac op;
+        switch (n.op) {
+            case OP_MAIS: op = TAC_SOMA; break;
+            case OP_MENOS: op = TAC_SUB; break;
+            case OP_VEZES: op = TAC_MUL; break;
+            case OP_BARRA: op = TAC_BARRA; break;
+            case PR_DIV: op = TAC_DIV; break;
+            case PR_MOD: op = TAC_MOD; break;
+            case PR_AND: op = TAC_E; break;
+            case PR_OR: op = TAC_OU; break;
+            case OP_IGUAL: op = TAC_IGUAL; break;
+            case OP_DIFERENTE: op = TAC_DIFERENTE; break;
+            case OP_MENOR: op = TAC_MENOR; break;
+            case OP_MAIOR: op = TAC_MAIOR; break;
+            case OP_MENOR_IGUAL: op = TAC_MENOR_IGUAL; break;
+            default: op = TAC_MAIOR_IGUAL; break;
+        }
+        TipoValor t = tr;
+        if (op >= TAC_IGUAL && op <= TAC_MAIOR_IGUAL) {
+            t = ta;
+        } else if (tr == V_DOUBLE) {
+            a = converte(a, ta, V_DOUBLE);
+            b = converte(b, tb, V_DOUBLE);
+        }
+        uint32_t res = codigo.novoTemp();
+        codigo.emite(op, t, res, a, b);
+        return res;
+    }
+
+    void comandos(uint32_t i) {
+        for (; i != SEM_NO; i = no(i).prox) comando(i);
+    }
+
+    void comando(uint32_t i) {
+        const No& n = no(i);
+        switch (n.classe) {
+            case N_ATRIBUICAO: {
+                TipoValor tv = tipoValor(n.tipo);
+                uint32_t v = converte(expressao(n.filho), tipoValor(no(n.filho).tipo), tv);
+                codigo.emite(TAC_COPIA, tv, operando(OPD_VAR, n.id), v);
+                break;
+            }
+            case N_LEITURA:
+                for (uint32_t f = n.filho; f != SEM_NO; f = no(f).prox) {
+                    codigo.emite(TAC_LEIA, tipoValor(no(f).tipo), operando(OPD_VAR, no(f).id));
+                }
+                break;
+            case N_ESCRITA:
+                for (uint32_t f = n.filho; f != SEM_NO; f = no(f).prox) {
+                    codigo.emite(TAC_ESCREVA, tipoValor(no(f).tipo), SEM_OPD, expressao(f));
+                }
+                break;
+            case N_SE: {
+                const No& cond = no(n.filho);
+                const No& entao = no(cond.prox);
+                uint32_t senao = codigo.novoRotulo();
+                codigo.emite(TAC_SE_FALSO, V_BOOLEAN, senao, expressao(n.filho));
+                comando(cond.prox);
+                if (entao.prox == SEM_NO) {
+                    codigo.emite(TAC_ROTULO, V_BOOLEAN, senao);
+                } else {
+                    uint32_t fim = codigo.novoRotulo();
+                    codigo.emite(TAC_SALTO, V_BOOLEAN, fim);
+                    codigo.emite(TAC_ROTULO, V_BOOLEAN, senao);
+                    comando(entao.prox);
+                    codigo.emite(TAC_ROTULO, V_BOOLEAN, fim);
+                }
+                break;
+            }
+            case N_ENQUANTO: {
+                uint32_t inicio = codigo.novoRotulo(), fim = codigo.novoRotulo();
+                codigo.emite(TAC_ROTULO, V_BOOLEAN, inicio);
+                codigo.emite(TAC_SE_FALSO, V_BOOLEAN, fim, expressao(n.filho));
+                comando(no(n.filho).prox);
+                codigo.emite(TAC_SALTO, V_BOOLEAN, inicio);
+                codigo.emite(TAC_ROTULO, V_BOOLEAN, fim);
+                break;
+            }
+            case N_COMPOSTO:
+                comandos(n.filho);
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+    GeradorIntermediario(const Arvore& a, const Fonte& f, CodigoIntermediario& c) : arvore(a), fonte(f), codigo(c) {}
+
+    void gerar() {
+        if (arvore.raiz == SEM_NO) return;
+        const No& bloco = no(no(arvore.raiz).filho);
+        comando(no(bloco.filho).prox);
+    }
+};
+
+// Aritmetica inteira dos programas compilados: 64 bits em complemento de dois,
+// com estouro dando a volta. Divisao por zero nao tem valor e fica para a execucao
+inline int64_t somaInt(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+inline int64_t subInt(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+inline int64_t mulInt(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+inline int64_t divInt(int64_t a, int64_t b) { return b == -1 ? subInt(0, a) : a / b; }
+inline int64_t modInt(int64_t a, int64_t b) { return b == -1 ? 0 : a % b; }
+
+template <class T>
+bool comparaTac(OpTac op, T a, T b) {
+    switch (op) {
+        case TAC_IGUAL: return a == b;
+        case TAC_DIFERENTE: return a != b;
+        case TAC_MENOR: return a < b;
+        case TAC_MAIOR: return a > b;
+        case TAC_MENOR_IGUAL: return a <= b;
+        default: return a >= b;
+    }
+}
+
+// Valor de 'a op b' com constantes; falso quando nao da para calcular agora
+bool avaliaTac(OpTac op, TipoValor tipo, const Constante& a, const Constante& b, Constante& r) {
+    r = {tipo, 0, 0.0, {}};
+    if (op >= TAC_IGUAL && op <= TAC_MAIOR_IGUAL) {
+        r.tipo = V_BOOLEAN;
+        if (tipo == V_DOUBLE) r.inteiro = comparaTac(op, a.real, b.real);
+        else if (tipo == V_STRING) r.inteiro = comparaTac(op, a.texto, b.texto);
+        else r.inteiro = comparaTac(op, a.inteiro, b.inteiro);
+        return true;
+    }
+    switch (op) {
+        case TAC_COPIA: r = a; return true;
+        case TAC_NAO: r.inteiro = !a.inteiro; return true;
+        case TAC_PARA_REAL: r.real = (double)a.inteiro; return true;
+        case TAC_E: r.inteiro = a.inteiro && b.inteiro; return true;
+        case TAC_OU: r.inteiro = a.inteiro || b.inteiro; return true;
+        default: break;
+    }
+    if (tipo == V_DOUBLE) {
+        switch (op) {
+            case TAC_SOMA: r.real = a.real + b.real; return true;
+            case TAC_SUB: r.real = a.real - b.real; return true;
+            case TAC_MUL: r.real = a.real * b.real; return true;
+            case TAC_BARRA: r.real = a.real / b.real; return true;
+            default: return false;
+        }
+    }
+    switch (op) {
+        case TAC_SOMA: r.inteiro = somaInt(a.inteiro, b.inteiro); return true;
+        case TAC_SUB: r.inteiro = subInt(a.inteiro, b.inteiro); return true;
+        case TAC_MUL: r.inteiro = mulInt(a.inteiro, b.inteiro); return true;
+        case TAC_BARRA: case TAC_DIV:
+            if (b.inteiro == 0) return false;
+            r.inteiro = divInt(a.inteiro, b.inteiro);
+            return true;
+        case TAC_MOD:
+            if (b.inteiro == 0) return false;
+            r.inteiro = modInt(a.inteiro, b.inteiro);
+            return true;
+        default: return false;
+    }
+}
+
+// Otimizacoes sobre o codigo de tres enderecos. Cada passo devolve quantas
+// mudancas fez; o nivel escolhe quais rodam e se repetem ate estabilizar
+class Otimizador {
+public:
+    struct Estatistica {
+        const char* nome;
+        uint64_t execucoes = 0;
+        uint64_t mudancas = 0;
+        uint64_t removidas = 0; // instrucoes a menos no codigo
+        double ms = 0;
+    };
+
+private:
+    CodigoIntermediario& codigo;
+    uint32_t numVars;
+    vector<Estatistica> estatisticas;
+
+    static bool temDestino(OpTac op) {
+        return op != TAC_ROTULO && op != TAC_SALTO && op != TAC_SE_FALSO && op != TAC_ESCREVA;
+    }
+
+    static bool desvia(OpTac op) {
+        return op == TAC_SALTO || op == TAC_SE_FALSO;
+    }
+
+    // Divisao inteira por valor que pode ser zero tem que continuar la para falhar
+    bool podeFalhar(size_t i) const {
+        OpTac op = codigo.op[i];
+        if ((op != TAC_DIV && op != TAC_MOD && op != TAC_BARRA) || codigo.tipo[i] == V_DOUBLE) return false;
+        uint32_t d = codigo.src2[i];
+        return classeOpd(d) != OPD_CONST || codigo.constantes[indiceOpd(d)].inteiro == 0;
+    }
+
+    // Variaveis e temporarios numa numeracao so, para indexar vetores; SEM_OPD nos outros
+    uint32_t chave(uint32_t opd) const {
+        if (opd == SEM_OPD) return SEM_OPD;
+        ClasseOperando c = classeOpd(opd);
+        if (c == OPD_VAR) return indiceOpd(opd);
+        if (c == OPD_TEMP) return numVars + indiceOpd(opd);
+        return SEM_OPD;
+    }
+
+    uint32_t numChaves() const {
+        return numVars + codigo.numTemps;
+    }
+
+    // Constantes e copias conhecidas dentro de cada bloco basico substituem os usos,
+    // e o que fica todo constante e dobrado. Um valor copiado de x vale so enquanto
+    // x nao muda (versao). Tambem junta 't := a op b; v := t' em 'v := a op b'
+    // quando t so e usado ali
+    uint64_t propagacao() {
+        uint32_t n = numChaves();
+        vector<uint32_t> valor(n, SEM_OPD), blocoValor(n, UINT32_MAX), versao(n, 0), versaoFonte(n, 0);
+        vector<uint32_t> usos(codigo.numTemps, 0);
+        uint32_t bloco = 0;
+        uint64_t mudancas = 0;
+
+        auto substitui = [&](uint32_t& opd) {
+            uint32_t k = chave(opd);
+            if (k == SEM_OPD || blocoValor[k] != bloco || valor[k] == SEM_OPD) return;
+            uint32_t kf = chave(valor[k]);
+            if (kf != SEM_OPD && versao[kf] != versaoFonte[k]) return;
+            opd = valor[k];
+            mudancas++;
+        };
+
+        size_t total = codigo.tamanho();
+        for (size_t i = 0; i < total; i++) {
+            OpTac op = codigo.op[i];
+            if (op == TAC_ROTULO) bloco++;
+            substitui(codigo.src1[i]);
+            substitui(codigo.src2[i]);
+            // Dobra na hora para o resultado ja seguir adiante nesta mesma varredura
+            if (dobra(i)) {
+                op = TAC_COPIA;
+                mudancas++;
+            }
+            if (desvia(op)) bloco++;
+            if (!temDestino(op)) continue;
+            uint32_t k = chave(codigo.dst[i]);
+            versao[k]++;
+            valor[k] = SEM_OPD;
+            // Copia de temporario nao se espalha: ele e juntado ao calculo logo abaixo
+            if (op == TAC_COPIA && codigo.src1[i] != codigo.dst[i] && classeOpd(codigo.src1[i]) != OPD_TEMP) {
+                uint32_t kf = chave(codigo.src1[i]);
+                valor[k] = codigo.src1[i];
+                blocoValor[k] = bloco;
+                versaoFonte[k] = kf == SEM_OPD ? 0 : versao[kf];
+            }
+        }
+
+        for (size_t i = 0; i < total; i++) {
+            for (uint32_t s : {codigo.src1[i], codigo.src2[i]}) {
+                if (s != SEM_OPD && classeOpd(s) == OPD_TEMP) usos[indiceOpd(s)]++;
+            }
+        }
+        vector<uint8_t> morta(total, 0);
+        for (size_t i = 1; i < total; i++) {
+            uint32_t t = codigo.src1[i];
+            if (codigo.op[i] != TAC_COPIA || t == SEM_OPD || classeOpd(t) != OPD_TEMP || usos[indiceOpd(t)] != 1) continue;
+            if (morta[i - 1] || codigo.dst[i - 1] != t || !temDestino(codigo.op[i - 1]) || codigo.op[i - 1] == TAC_LEIA) continue;
+            codigo.dst[i - 1] = codigo.dst[i];
+            morta[i] = 1;
+            mudancas++;
+        }
+        codigo.remove(morta);
+        return mudancas;
+    }
+
+    // Operacao com todos os operandos constantes vira copia do resultado
+    bool dobra(size_t i) {
+        OpTac op = codigo.op[i];
+        if (!temDestino(op) || op == TAC_LEIA || op == TAC_COPIA) return false;
+        uint32_t a = codigo.src1[i], b = codigo.src2[i];
+        if (classeOpd(a) != OPD_CONST || (b != SEM_OPD && classeOpd(b) != OPD_CONST)) return false;
+        Constante r;
+        Constante cb = b == SEM_OPD ? Constante{} : codigo.constantes[indiceOpd(b)];
+        if (!avaliaTac(op, codigo.tipo[i], codigo.constantes[indiceOpd(a)], cb, r)) return false;
+        codigo.op[i] = TAC_COPIA;
+        codigo.tipo[i] = r.tipo;
+        codigo.src1[i] = codigo.constante(r);
+        codigo.src2[i] = SEM_OPD;
+        return true;
+    }
+
+    // 'ifFalse' de constante vira salto incondicional ou desaparece
+    uint64_t dobraDesvios() {
+        uint64_t mudancas = 0;
+        vector<uint8_t> morta(codigo.tamanho(), 0);
+        for (size_t i = 0; i < codigo.tamanho(); i++) {
+            if (codigo.op[i] != TAC_SE_FALSO || classeOpd(codigo.src1[i]) != OPD_CONST) continue;
+            if (codigo.constantes[indiceOpd(codigo.src1[i])].inteiro) {
+                morta[i] = 1;
+            } else {
+                codigo.op[i] = TAC_SALTO;
+                codigo.src1[i] = SEM_OPD;
+            }
+            mudancas++;
+        }
+        codigo.remove(morta);
+        return mudancas;
+    }
+
+    // Tira os blocos que nao sao alcancados a partir do inicio, os saltos para a
+    // instrucao seguinte e os rotulos que ninguem usa
+    uint64_t blocosInalcancaveis() {
+        size_t total = codigo.tamanho();
+        vector<uint32_t> posRotulo(codigo.numRotulos, UINT32_MAX);
+        for (size_t i = 0; i < total; i++) {
+            if (codigo.op[i] == TAC_ROTULO) posRotulo[indiceOpd(codigo.dst[i])] = (uint32_t)i;
+        }
+
+        vector<uint8_t> alcancada(total, 0);
+        vector<uint32_t> pendentes;
+        if (total) pendentes.push_back(0);
+        while (!pendentes.empty()) {
+            size_t i = pendentes.back();
+            pendentes.pop_back();
+            for (; i < total && !alcancada[i]; i++) {
+                alcancada[i] = 1;
+                OpTac op = codigo.op[i];
+                if (desvia(op)) {
+                    pendentes.push_back(posRotulo[indiceOpd(codigo.dst[i])]);
+                    if (op == TAC_SALTO) break;
+                }
+            }
+        }
+
+        vector<uint8_t> morta(total, 0);
+        vector<uint32_t> referencias(codigo.numRotulos, 0);
+        uint64_t mudancas = 0;
+        for (size_t i = 0; i < total; i++) {
+            morta[i] = !alcancada[i];
+            mudancas += morta[i];
+        }
+        // Salto para o rotulo que ja vem em seguida (pulando so codigo morto e outros rotulos)
+        for (size_t i = 0; i < total; i++) {
+            if (morta[i] || codigo.op[i] != TAC_SALTO) continue;
+            for (size_t j = i + 1; j < total && (morta[j] || codigo.op[j] == TAC_ROTULO); j++) {
+                if (!morta[j] && codigo.dst[j] == codigo.dst[i]) {
+                    morta[i] = 1;
+                    mudancas++;
+                    break;
+                }
+            }
+        }
+        for (size_t i = 0; i < total; i++) {
+            if (!morta[i] && desvia(codigo.op[i])) referencias[indiceOpd(codigo.dst[i])]++;
+        }
+        for (size_t i = 0; i < total; i++) {
+            if (!morta[i] && codigo.op[i] == TAC_ROTULO && !referencias[indiceOpd(codigo.dst[i])]) {
+                morta[i] = 1;
+                mudancas++;
+            }
+        }
+        codigo.remove(morta);
+        return mudancas;
+    }
+
+    // Atribuicoes cujo valor nunca e lido. Temporarios so vivem dentro do bloco
+    // onde nascem, entao a analise entre blocos so acompanha as variaveis
+    uint64_t armazenamentosMortos() {
+        size_t total = codigo.tamanho();
+        if (!total) return 0;
+
+        vector<uint32_t> inicio{0};
+        vector<uint32_t> posRotulo(codigo.numRotulos, 0);
+        for (size_t i = 0; i < total; i++) {
+            if (codigo.op[i] == TAC_ROTULO && i != inicio.back()) inicio.push_back((uint32_t)i);
+            if (desvia(codigo.op[i]) && i + 1 < total) inicio.push_back((uint32_t)(i + 1));
+        }
+        size_t numBlocos = inicio.size();
+        inicio.push_back((uint32_t)total);
+        // Conjuntos de variaveis em bits: um bloco de palavras por bloco basico
+        size_t palavras = (numVars + 63) / 64;
+        if ((double)numBlocos * (double)palavras > (1 << 26)) return 0;
+
+        vector<uint32_t> blocoDe(total);
+        for (size_t b = 0; b < numBlocos; b++) {
+            for (uint32_t i = inicio[b]; i < inicio[b + 1]; i++) blocoDe[i] = (uint32_t)b;
+        }
+        for (size_t i = 0; i < total; i++) {
+            if (codigo.op[i] == TAC_ROTULO) posRotulo[indiceOpd(codigo.dst[i])] = blocoDe[i];
+        }
+
+        vector<uint64_t> vivaSaida(numBlocos * palavras, 0), vivaEntrada(numBlocos * palavras, 0);
+        vector<uint64_t> atual(palavras);
+        auto usa = [&](uint32_t opd) {
+            if (opd != SEM_OPD && classeOpd(opd) == OPD_VAR) atual[indiceOpd(opd) / 64] |= 1ull << (indiceOpd(opd) % 64);
+        };
+        auto define = [&](uint32_t opd) {
+            if (classeOpd(opd) == OPD_VAR) atual[indiceOpd(opd) / 64] &= ~(1ull << (indiceOpd(opd) % 64));
+        };
+        auto une = [&](size_t b, size_t sucessor) {
+            for (size_t w = 0; w < palavras; w++) vivaSaida[b * palavras + w] |= vivaEntrada[sucessor * palavras + w];
+        };
+
+        // Ponto fixo de tras para frente; cada bloco: entrada = usos + (saida - definicoes)
+        for (bool mudou = true; mudou;) {
+            mudou = false;
+            for (size_t b = numBlocos; b-- > 0;) {
+                uint32_t ult = inicio[b + 1] - 1;
+                OpTac op = codigo.op[ult];
+                if (op != TAC_SALTO && b + 1 < numBlocos) une(b, b + 1);
+                if (desvia(op)) une(b, posRotulo[indiceOpd(codigo.dst[ult])]);
+                copy(vivaSaida.begin() + b * palavras, vivaSaida.begin() + (b + 1) * palavras, atual.begin());
+                for (uint32_t i = ult + 1; i-- > inicio[b];) {
+                    if (temDestino(codigo.op[i])) define(codigo.dst[i]);
+                    usa(codigo.src1[i]);
+                    usa(codigo.src2[i]);
+                }
+                if (!equal(atual.begin(), atual.end(), vivaEntrada.begin() + b * palavras)) {
+                    copy(atual.begin(), atual.end(), vivaEntrada.begin() + b * palavras);
+                    mudou = true;
+                }
+            }
+        }
+
+        vector<uint8_t> morta(total, 0);
+        vector<uint8_t> tempViva(codigo.numTemps, 0);
+        uint64_t mudancas = 0;
+        for (size_t b = 0; b < numBlocos; b++) {
+            copy(vivaSaida.begin() + b * palavras, vivaSaida.begin() + (b + 1) * palavras, atual.begin());
+            for (uint32_t i = inicio[b + 1]; i-- > inicio[b];) {
+                OpTac op = codigo.op[i];
+                if (temDestino(op)) {
+                    uint32_t d = codigo.dst[i];
+                    bool viva = classeOpd(d) == OPD_VAR ? (atual[indiceOpd(d) / 64] >> (indiceOpd(d) % 64)) & 1
+                                                         : tempViva[indiceOpd(d)];
+                    if (op != TAC_LEIA && !podeFalhar(i) && (!viva || (op == TAC_COPIA && codigo.src1[i] == d))) {
+                        morta[i] = 1;
+                        mudancas++;
+                        continue;
+                    }
+                    define(d);
+                    if (classeOpd(d) == OPD_TEMP) tempViva[indiceOpd(d)] = 0;
+                }
+                for (uint32_t s : {codigo.src1[i], codigo.src2[i]}) {
+                    usa(s);
+                    if (s != SEM_OPD && classeOpd(s) == OPD_TEMP) tempViva[indiceOpd(s)] = 1;
+                }
+            }
+        }
+        codigo.remove(morta);
+        return mudancas;
+    }
+
+    uint64_t roda(size_t passo, uint64_t (Otimizador::*funcao)()) {
+        Estatistica& e = estatisticas[passo];
+        size_t antes = codigo.tamanho();
+        auto t0 = chrono::steady_clock::now();
+        uint64_t mudancas = (this->*funcao)();
+        e.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        e.execucoes++;
+        e.mudancas += mudancas;
+        e.removidas += antes - codigo.tamanho();
+        return mudancas;
+    }
+
+public:
+    Otimizador(CodigoIntermediario& c, uint32_t variaveis) : codigo(c), numVars(variaveis) {
+        for (const char* nome : {"propaga-e-dobra", "dobra-desvios", "blocos-inalcancaveis", "armazenamentos-mortos"}) {
+            estatisticas.push_back({nome});
+        }
+    }
+
+    // -O0 nao mexe no codigo; -O1 faz uma rodada sem a analise de vida;
+    // -O2 inclui os armazenamentos mortos e repete ate nada mudar
+    void otimizar(int nivel) {
+        if (nivel <= 0) return;
+        for (int rodada = 0; rodada < 16; rodada++) {
+            uint64_t mudancas = roda(0, &Otimizador::propagacao);
+            mudancas += roda(1, &Otimizador::dobraDesvios);
+            mudancas += roda(2, &Otimizador::blocosInalcancaveis);
+            if (nivel < 2) break;
+            mudancas += roda(3, &Otimizador::armazenamentosMortos);
+            if (!mudancas) break;
+        }
+    }
+
+    const vector<Estatistica>& getEstatisticas() const {
+        return estatisticas;
+    }
+};
+
+// Double com o menor numero de digitos que volta ao mesmo valor
+string formataReal(double v) {
+    if (v != v) return "nan"; // printf pode escrever "-nan" conforme o sinal
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.15g", v);
+    if (strtod(buf, nullptr) != v) snprintf(buf, sizeof buf, "%.17g", v);
+    string s = buf;
+    if (s.find_first_of(".eni") == string::npos) s += ".0";
+    return s;
+}
+
+string nomeOperando(const CodigoIntermediario& codigo, const Internador& nomes, uint32_t opd) {
+    uint32_t i = indiceOpd(opd);
+    switch (classeOpd(opd)) {
+        case OPD_VAR: return string(nomes.nome(i));
+        case OPD_TEMP: return "t" + to_string(i);
+        case OPD_ROTULO: return "L" + to_string(i);
+        default: break;
+    }
+    const Constante& c = codigo.constantes[i];
+    switch (c.tipo) {
+        case V_INTEGER: return to_string(c.inteiro);
+        case V_DOUBLE: return formataReal(c.real);
+        case V_BOOLEAN: return c.inteiro ? "true" : "false";
+        default: return "\"" + string(c.texto) + "\"";
+    }
+}
+
+void gravaIntermediario(const CodigoIntermediario& codigo, const Internador& nomes, ostream& saida) {
+    auto nome = [&](uint32_t opd) { return nomeOperando(codigo, nomes, opd); };
+    for (size_t i = 0; i < codigo.tamanho(); i++) {
+        OpTac op = codigo.op[i];
+        switch (op) {
+            case TAC_ROTULO: saida << nome(codigo.dst[i]) << ":\n"; break;
+            case TAC_SALTO: saida << "    goto " << nome(codigo.dst[i]) << "\n"; break;
+            case TAC_SE_FALSO: saida << "    ifFalse " << nome(codigo.src1[i]) << " goto " << nome(codigo.dst[i]) << "\n"; break;
+            case TAC_LEIA: saida << "    read " << nome(codigo.dst[i]) << "\n"; break;
+            case TAC_ESCREVA: saida << "    write " << nome(codigo.src1[i]) << "\n"; break;
+            case TAC_COPIA: saida << "    " << nome(codigo.dst[i]) << " := " << nome(codigo.src1[i]) << "\n"; break;
+            case TAC_NAO: case TAC_PARA_REAL:
+                saida << "    " << nome(codigo.dst[i]) << " := " << textoOpTac[op] << " " << nome(codigo.src1[i]) << "\n";
+                break;
+            default:
+                saida << "    " << nome(codigo.dst[i]) << " := " << nome(codigo.src1[i]) << " " << textoOpTac[op] << " " << nome(codigo.src2[i]) << "\n";
+        }
+    }
+}
+
+// Maquina virtual de registradores. Cada instrucao le e escreve slots de um
+// array plano: primeiro as variaveis (pelo id do Internador), depois os
+// temporarios e por fim as constantes, que ja comecam carregadas
+union Valor {
+    int64_t i; // integer, boolean e indice de texto
+    double d;
+};
+
+// Lista unica das operacoes: gera o enum e a tabela de despacho na mesma ordem.
+// SF_* sao comparacao e ifFalse juntos: salta para c se 'a rel b' for falso
+#define OPS_VM(X) \
+    X(VM_MOV) X(VM_PARA_REAL) \
+    X(VM_SOMA_I) X(VM_SUB_I) X(VM_MUL_I) X(VM_DIV_I) X(VM_MOD_I) \
+    X(VM_SOMA_D) X(VM_SUB_D) X(VM_MUL_D) X(VM_DIV_D) \
+    X(VM_IGUAL_I) X(VM_DIF_I) X(VM_MENOR_I) X(VM_MAIOR_I) X(VM_MENOR_IGUAL_I) X(VM_MAIOR_IGUAL_I) \
+    X(VM_IGUAL_D) X(VM_DIF_D) X(VM_MENOR_D) X(VM_MAIOR_D) X(VM_MENOR_IGUAL_D) X(VM_MAIOR_IGUAL_D) \
+    X(VM_SF_IGUAL_I) X(VM_SF_DIF_I) X(VM_SF_MENOR_I) X(VM_SF_MAIOR_I) X(VM_SF_MENOR_IGUAL_I) X(VM_SF_MAIOR_IGUAL_I) \
+    X(VM_SF_IGUAL_D) X(VM_SF_DIF_D) X(VM_SF_MENOR_D) X(VM_SF_MAIOR_D) X(VM_SF_MENOR_IGUAL_D) X(VM_SF_MAIOR_IGUAL_D) \
+    X(VM_E) X(VM_OU) X(VM_NAO) \
+    X(VM_SALTO) X(VM_SE_FALSO) \
+    X(VM_LEIA_I) X(VM_LEIA_D) X(VM_LEIA_B) \
+    X(VM_ESCREVA_I) X(VM_ESCREVA_D) X(VM_ESCREVA_B) X(VM_ESCREVA_S) \
+    X(VM_FIM)
+
+#define VM_ENUM(op) op,
+enum OpVM : uint32_t { OPS_VM(VM_ENUM) NUM_OP_VM };
+#undef VM_ENUM
+
+struct InstrVM {
+    OpVM op;
+    uint32_t a; // destino (ou operando de leia/escreva)
+    uint32_t b;
+    uint32_t c; // segundo operando, ou alvo dos saltos
+};
+
+struct ProgramaVM {
+    vector<InstrVM> codigo;
+    vector<Valor> slots;      // valores iniciais: zero nas variaveis e temporarios
+    vector<string_view> textos;
+};
+
+// Traduz o codigo de tres enderecos (ja otimizado) para a maquina virtual
+ProgramaVM traduzVM(const CodigoIntermediario& tac, uint32_t numVars) {
+    ProgramaVM prog;
+    uint32_t baseConst = numVars + tac.numTemps;
+    prog.slots.assign(baseConst + tac.constantes.size(), Valor{0});
+    for (size_t c = 0; c < tac.constantes.size(); c++) {
+        const Constante& k = tac.constantes[c];
+        Valor& v = prog.slots[baseConst + c];
+        if (k.tipo == V_DOUBLE) {
+            v.d = k.real;
+        } else if (k.tipo == V_STRING) {
+            v.i = (int64_t)prog.textos.size();
+            prog.textos.push_back(k.texto);
+        } else {
+            v.i = k.inteiro;
+        }
+    }
+    auto slot = [&](uint32_t opd) -> uint32_t {
+        if (opd == SEM_OPD) return 0;
+        uint32_t i = indiceOpd(opd);
+        switch (classeOpd(opd)) {
+            case OPD_VAR: return i;
+            case OPD_TEMP: return numVars + i;
+            case OPD_CONST: return baseConst + i;
+            default: return i; // rotulo, resolvido depois
+        }
+    };
+
+    // Temporario usado so pelo ifFalse seguinte deixa a comparacao virar salto direto
+    vector<uint32_t> usos(tac.numTemps, 0);
+    for (size_t i = 0; i < tac.tamanho(); i++) {
+        for (uint32_t s : {tac.src1[i], tac.src2[i]}) {
+            if (s != SEM_OPD && classeOpd(s) == OPD_TEMP) usos[indiceOpd(s)]++;
+        }
+    }
+
+    vector<uint32_t> posRotulo(tac.numRotulos, 0);
+    vector<size_t> saltos;
+    for (size_t i = 0; i < tac.tamanho(); i++) {
+        OpTac op = tac.op[i];
+        TipoValor t = tac.tipo[i];
+        uint32_t a = slot(tac.dst[i]), b = slot(tac.src1[i]), c = slot(tac.src2[i]);
+        bool real = t == V_DOUBLE;
+        switch (op) {
+            case TAC_ROTULO:
+                posRotulo[indiceOpd(tac.dst[i])] = (uint32_t)prog.codigo.size();
+                continue;
+            case TAC_SALTO:
+                saltos.push_back(prog.codigo.size());
+                prog.codigo.push_back({VM_SALTO, 0, 0, a});
+                continue;
+            case TAC_SE_FALSO:
+                saltos.push_back(prog.codigo.size());
+                prog.codigo.push_back({VM_SE_FALSO, b, 0, a});
+                continue;
+            case TAC_IGUAL: case TAC_DIFERENTE: case TAC_MENOR: case TAC_MAIOR: case TAC_MENOR_IGUAL: case TAC_MAIOR_IGUAL: {
+                if (t == V_STRING) {
+                    // Strings so existem como literais: a comparacao e resolvida aqui
+                    Constante r;
+                    avaliaTac(op, t, tac.constantes[indiceOpd(tac.src1[i])], tac.constantes[indiceOpd(tac.src2[i])], r);
+                    prog.slots[a].i = r.inteiro;
+                    continue;
+                }
+                uint32_t rel = op - TAC_IGUAL;
+                uint32_t d = tac.dst[i];
+                if (i + 1 < tac.tamanho() && tac.op[i + 1] == TAC_SE_FALSO && tac.src1[i + 1] == d &&
+                    classeOpd(d) == OPD_TEMP && usos[indiceOpd(d)] == 1) {
+                    saltos.push_back(prog.codigo.size());
+                    prog.codigo.push_back({(OpVM)((real ? VM_SF_IGUAL_D : VM_SF_IGUAL_I) + rel), b, c, slot(tac.dst[i + 1])});
+                    i++;
+                    continue;
+                }
+                prog.codigo.push_back({(OpVM)((real ? VM_IGUAL_D : VM_IGUAL_I) + rel), a, b, c});
+                continue;
+            }
+            default:
+                break;
+        }
+        OpVM o;
+        switch (op) {
+            case TAC_COPIA: o = VM_MOV; break;
+            case TAC_PARA_REAL: o = VM_PARA_REAL; break;
+            case TAC_SOMA: o = real ? VM_SOMA_D : VM_SOMA_I; break;
+            case TAC_SUB: o = real ? VM_SUB_D : VM_SUB_I; break;
+            case TAC_MUL: o = real ? VM_MUL_D : VM_MUL_I; break;
+            case TAC_BARRA: o = real ? VM_DIV_D : VM_DIV_I; break;
+            case TAC_DIV: o = VM_DIV_I; break;
+            case TAC_MOD: o = VM_MOD_I; break;
+            case TAC_E: o = VM_E; break;
+            case TAC_OU: o = VM_OU; break;
+            case TAC_NAO: o = VM_NAO; break;
+            case TAC_LEIA: o = real ? VM_LEIA_D : t == V_BOOLEAN ? VM_LEIA_B : VM_LEIA_I; break;
+            default:
+                o = real ? VM_ESCREVA_D : t == V_BOOLEAN ? VM_ESCREVA_B : t == V_STRING ? VM_ESCREVA_S : VM_ESCREVA_I;
+                a = b;
+                break;
+        }
+        prog.codigo.push_back({o, a, b, c});
+    }
+    prog.codigo.push_back({VM_FIM, 0, 0, 0});
+    for (size_t s : saltos) prog.codigo[s].c = posRotulo[prog.codigo[s].c];
+    return prog;
+}
+
+// Executa um ProgramaVM; a saida do programa vai para 'saida' e a entrada vem de 'entrada'
+class MaquinaVirtual {
+    const ProgramaVM& prog;
+    istream& entrada;
+    ostream& saida;
+    string buffer;
+    string erro;
+
+    void descarrega() {
+        saida.write(buffer.data(), (streamsize)buffer.size());
+        saida.flush();
+        buffer.clear();
+    }
+
+    bool leToken(string& tok) {
+        descarrega();
+        return (bool)(entrada >> tok);
+    }
+
+    bool leInteiro(int64_t& v) {
+        string tok;
+        if (!leToken(tok)) return false;
+        char* fim;
+        errno = 0;
+        v = strtoll(tok.c_str(), &fim, 10);
+        return *fim == '\0' && errno == 0;
+    }
+
+    bool leReal(double& v) {
+        string tok;
+        if (!leToken(tok)) return false;
+        char* fim;
+        v = strtod(tok.c_str(), &fim);
+        return *fim == '\0';
+    }
+
+    bool leBooleano(int64_t& v) {
+        string tok;
+        if (!leToken(tok)) return false;
+        for (char& ch : tok) ch = (char)tolower((unsigned char)ch);
+        if (tok != "true" && tok != "false" && tok != "1" && tok != "0") return false;
+        v = tok == "true" || tok == "1";
+        return true;
+    }
+
+    void escreveInteiro(int64_t v) {
+        char buf[24];
+        char* p = buf + sizeof buf;
+        uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+        do {
+            *--p = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) *--p = '-';
+        escreveTexto(string_view(p, buf + sizeof buf - p));
+    }
+
+    // Toda escrita passa por aqui: o buffer nunca passa muito de 64 KiB
+    void escreveTexto(string_view s) {
+        buffer.append(s);
+        if (buffer.size() > (1 << 16)) descarrega();
+    }
+
+public:
+    MaquinaVirtual(const ProgramaVM& p, istream& e, ostream& s) : prog(p), entrada(e), saida(s) {}
+
+    // Devolve falso se o programa parou com erro de execucao (ver getErro)
+    bool executa() {
+        vector<Valor> slots = prog.slots;
+        Valor* r = slots.data();
+        const InstrVM* codigo = prog.codigo.data();
+        const InstrVM* pc = codigo;
+
+#if defined(__GNUC__)
+#define VM_ENDERECO(op) &&L_##op,
+        static void* const despacho[NUM_OP_VM] = { OPS_VM(VM_ENDERECO) };
+#undef VM_ENDERECO
+#define CASO(op) L_##op:
+#define PROXIMO goto *despacho[pc->op]
+        PROXIMO;
+#else
+#define CASO(op) case op:
+#define PROXIMO continue
+        for (;;) switch (pc->op) {
+#endif
+        CASO(VM_MOV) r[pc->a] = r[pc->b]; pc++; PROXIMO;
+        CASO(VM_PARA_REAL) r[pc->a].d = (double)r[pc->b].i; pc++; PROXIMO;
+        CASO(VM_SOMA_I) r[pc->a].i = somaInt(r[pc->b].i, r[pc->c].i); pc++; PROXIMO;
+        CASO(VM_SUB_I) r[pc->a].i = subInt(r[pc->b].i, r[pc->c].i); pc++; PROXIMO;
+        CASO(VM_MUL_I) r[pc->a].i = mulInt(r[pc->b].i, r[pc->c].i); pc++; PROXIMO;
+        CASO(VM_DIV_I)
+            if (r[pc->c].i == 0) goto divisaoPorZero;
+            r[pc->a].i = divInt(r[pc->b].i, r[pc->c].i); pc++; PROXIMO;
+        CASO(VM_MOD_I)
+            if (r[pc->c].i == 0) goto divisaoPorZero;
+            r[pc->a].i = modInt(r[pc->b].i, r[pc->c].i); pc++; PROXIMO;
+        CASO(VM_SOMA_D) r[pc->a].d = r[pc->b].d + r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_SUB_D) r[pc->a].d = r[pc->b].d - r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_MUL_D) r[pc->a].d = r[pc->b].d * r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_DIV_D) r[pc->a].d = r[pc->b].d / r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_IGUAL_I) r[pc->a].i = r[pc->b].i == r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_DIF_I) r[pc->a].i = r[pc->b].i != r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_MENOR_I) r[pc->a].i = r[pc->b].i < r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_MAIOR_I) r[pc->a].i = r[pc->b].i > r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_MENOR_IGUAL_I) r[pc->a].i = r[pc->b].i <= r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_MAIOR_IGUAL_I) r[pc->a].i = r[pc->b].i >= r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_IGUAL_D) r[pc->a].i = r[pc->b].d == r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_DIF_D) r[pc->a].i = r[pc->b].d != r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_MENOR_D) r[pc->a].i = r[pc->b].d < r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_MAIOR_D) r[pc->a].i = r[pc->b].d > r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_MENOR_IGUAL_D) r[pc->a].i = r[pc->b].d <= r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_MAIOR_IGUAL_D) r[pc->a].i = r[pc->b].d >= r[pc->c].d; pc++; PROXIMO;
+        CASO(VM_SF_IGUAL_I) pc = r[pc->a].i == r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_DIF_I) pc = r[pc->a].i != r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MENOR_I) pc = r[pc->a].i < r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MAIOR_I) pc = r[pc->a].i > r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MENOR_IGUAL_I) pc = r[pc->a].i <= r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MAIOR_IGUAL_I) pc = r[pc->a].i >= r[pc->b].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_IGUAL_D) pc = r[pc->a].d == r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_DIF_D) pc = r[pc->a].d != r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MENOR_D) pc = r[pc->a].d < r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MAIOR_D) pc = r[pc->a].d > r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MENOR_IGUAL_D) pc = r[pc->a].d <= r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_SF_MAIOR_IGUAL_D) pc = r[pc->a].d >= r[pc->b].d ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_E) r[pc->a].i = r[pc->b].i & r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_OU) r[pc->a].i = r[pc->b].i | r[pc->c].i; pc++; PROXIMO;
+        CASO(VM_NAO) r[pc->a].i = !r[pc->b].i; pc++; PROXIMO;
+        CASO(VM_SALTO) pc = codigo + pc->c; PROXIMO;
+        CASO(VM_SE_FALSO) pc = r[pc->a].i ? pc + 1 : codigo + pc->c; PROXIMO;
+        CASO(VM_LEIA_I) if (!leInteiro(r[pc->a].i)) goto entradaInvalida; pc++; PROXIMO;
+        CASO(VM_LEIA_D) if (!leReal(r[pc->a].d)) goto entradaInvalida; pc++; PROXIMO;
+        CASO(VM_LEIA_B) if (!leBooleano(r[pc->a].i)) goto entradaInvalida; pc++; PROXIMO;
+        CASO(VM_ESCREVA_I) escreveInteiro(r[pc->a].i); pc++; PROXIMO;
+        CASO(VM_ESCREVA_D) escreveTexto(formataReal(r[pc->a].d)); pc++; PROXIMO;
+        CASO(VM_ESCREVA_B) escreveTexto(r[pc->a].i ? "true" : "false"); pc++; PROXIMO;
+        CASO(VM_ESCREVA_S) escreveTexto(prog.textos[r[pc->a].i]); pc++; PROXIMO;
+        CASO(VM_FIM) descarrega(); return true;
+#if !defined(__GNUC__)
+        }
+#endif
+#undef CASO
+#undef PROXIMO
+
+    divisaoPorZero:
+        erro = "Divisao por zero";
+        descarrega();
+        return false;
+    entradaInvalida:
+        erro = "Entrada invalida para 'read'";
+        descarrega();
+        return false;
+    }
+
+    const string& getErro() const {
+        return erro;
+    }
+};
+
+// Rotinas de apoio do executavel nativo, sobre a libc: read/write com o mesmo
+// formato da maquina virtual e a saida por erro de execucao
+const char* const RUNTIME_ASM = R"(
+    .section .rodata
+.Lfmt_int:   .asciz "%lld"
+.Lfmt_str:   .asciz "%s"
+.Lfmt_15:    .asciz "%.15g"
+.Lfmt_17:    .asciz "%.17g"
+.Lfmt_tok:   .asciz "%ms"
+.Ltrue:      .asciz "true"
+.Lfalse:     .asciz "false"
+.Lum:        .asciz "1"
+.Lzero:      .asciz "0"
+.Lnan:       .asciz "nan"
+.Lsem_ponto: .asciz ".eni"
+.Lerro_div:  .asciz "Erro de execucao: Divisao por zero.\n"
+.Lerro_ent:  .asciz "Erro de execucao: Entrada invalida para 'read'.\n"
+
+    .text
+_pas_escreve_int:
+    subq $8, %rsp
+    movq %rdi, %rsi
+    leaq .Lfmt_int(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+_pas_escreve_str:
+    subq $8, %rsp
+    movq %rdi, %rsi
+    leaq .Lfmt_str(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+_pas_escreve_bool:
+    leaq .Ltrue(%rip), %rax
+    leaq .Lfalse(%rip), %rcx
+    testq %rdi, %rdi
+    cmoveq %rcx, %rax
+    movq %rax, %rdi
+    jmp _pas_escreve_str
+
+# Menor numero de digitos que volta ao mesmo double, como formataReal
+_pas_escreve_real:
+    subq $56, %rsp
+    movsd %xmm0, 40(%rsp)
+    ucomisd %xmm0, %xmm0
+    jp 3f
+    movq %rsp, %rdi
+    movl $32, %esi
+    leaq .Lfmt_15(%rip), %rdx
+    movl $1, %eax
+    call snprintf@PLT
+    movq %rsp, %rdi
+    xorl %esi, %esi
+    call strtod@PLT
+    ucomisd 40(%rsp), %xmm0
+    jp 1f
+    je 2f
+1:  movq %rsp, %rdi
+    movl $32, %esi
+    leaq .Lfmt_17(%rip), %rdx
+    movsd 40(%rsp), %xmm0
+    movl $1, %eax
+    call snprintf@PLT
+2:  movq %rsp, %rdi
+    leaq .Lsem_ponto(%rip), %rsi
+    call strpbrk@PLT
+    testq %rax, %rax
+    jne 4f
+    movq %rsp, %rdi
+    call strlen@PLT
+    movb $46, (%rsp,%rax)
+    movb $48, 1(%rsp,%rax)
+    movb $0, 2(%rsp,%rax)
+4:  movq %rsp, %rdi
+    call _pas_escreve_str
+    addq $56, %rsp
+    ret
+3:  leaq .Lnan(%rip), %rdi
+    call _pas_escreve_str
+    addq $56, %rsp
+    ret
+
+# Le um token inteiro (como o >> da VM) e o devolve alocado em %rax; o chamador libera.
+# Os read convertem com strtoll/strtod e exigem que o numero ocupe o token todo,
+# as mesmas regras da maquina virtual: "12abc" e entrada invalida nos dois
+_pas_le_token:
+    subq $24, %rsp
+    leaq .Lfmt_tok(%rip), %rdi
+    leaq 8(%rsp), %rsi
+    xorl %eax, %eax
+    call scanf@PLT
+    cmpl $1, %eax
+    jne _pas_erro_entrada
+    movq 8(%rsp), %rax
+    addq $24, %rsp
+    ret
+
+_pas_le_int:
+    pushq %rbx
+    subq $16, %rsp
+    call _pas_le_token
+    movq %rax, %rbx
+    call __errno_location@PLT
+    movl $0, (%rax)
+    movq %rbx, %rdi
+    leaq 8(%rsp), %rsi
+    movl $10, %edx
+    call strtoll@PLT
+    movq %rax, (%rsp)
+    call __errno_location@PLT
+    cmpl $0, (%rax)
+    jne _pas_erro_entrada
+    movq 8(%rsp), %rax
+    cmpb $0, (%rax)
+    jne _pas_erro_entrada
+    movq %rbx, %rdi
+    call free@PLT
+    movq (%rsp), %rax
+    addq $16, %rsp
+    popq %rbx
+    ret
+
+_pas_le_real:
+    pushq %rbx
+    subq $16, %rsp
+    call _pas_le_token
+    movq %rax, %rbx
+    movq %rax, %rdi
+    leaq 8(%rsp), %rsi
+    call strtod@PLT
+    movsd %xmm0, (%rsp)
+    movq 8(%rsp), %rax
+    cmpb $0, (%rax)
+    jne _pas_erro_entrada
+    movq %rbx, %rdi
+    call free@PLT
+    movsd (%rsp), %xmm0
+    addq $16, %rsp
+    popq %rbx
+    ret
+
+_pas_le_bool:
+    pushq %rbx
+    pushq %r12
+    subq $8, %rsp
+    call _pas_le_token
+    movq %rax, %rbx
+    movl $1, %r12d
+    movq %rbx, %rdi
+    leaq .Ltrue(%rip), %rsi
+    call strcasecmp@PLT
+    testl %eax, %eax
+    je 1f
+    movq %rbx, %rdi
+    leaq .Lum(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    je 1f
+    xorl %r12d, %r12d
+    movq %rbx, %rdi
+    leaq .Lfalse(%rip), %rsi
+    call strcasecmp@PLT
+    testl %eax, %eax
+    je 1f
+    movq %rbx, %rdi
+    leaq .Lzero(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    jne _pas_erro_entrada
+1:  movq %rbx, %rdi
+    call free@PLT
+    movq %r12, %rax
+    addq $8, %rsp
+    popq %r12
+    popq %rbx
+    ret
+
+_pas_erro_entrada:
+    leaq .Lerro_ent(%rip), %rdi
+    jmp _pas_erro
+_pas_erro_div:
+    leaq .Lerro_div(%rip), %rdi
+_pas_erro:
+    andq $-16, %rsp
+    pushq %rdi
+    pushq %rdi
+    xorl %edi, %edi
+    call fflush@PLT
+    movl $2, %edi
+    leaq .Lfmt_str(%rip), %rsi
+    movq (%rsp), %rdx
+    xorl %eax, %eax
+    call dprintf@PLT
+    movl $1, %edi
+    call exit@PLT
+)";
+
+// Gera assembly x86-64 (System V, sintaxe AT&T do GNU as) a partir do codigo de
+// tres enderecos. Variaveis e temporarios integer/boolean disputam registradores
+// por varredura linear; doubles ficam na memoria e passam por xmm0. rax, rcx e
+// rdx sao de rascunho
+class GeradorAssembly {
+    static constexpr int NUM_REGS = 11;
+    static constexpr int NUM_PRESERVADOS = 5; // os primeiros sobrevivem as chamadas da runtime
+    static constexpr const char* REGS[NUM_REGS] = {
+        "%rbx", "%r12", "%r13", "%r14", "%r15", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11"
+    };
+
+    struct Intervalo {
+        uint32_t chave;
+        uint32_t inicio;
+        uint32_t fim;
+    };
+
+    const CodigoIntermediario& tac;
+    const Internador& nomes;
+    uint32_t numVars;
+    ostream& out;
+
+    vector<int8_t> reg;        // chave -> registrador, ou -1 se fica na memoria
+    vector<uint8_t> ehReal;    // chave -> guarda double
+    vector<uint8_t> naMemoria; // chave que precisa de espaco em .bss
+    vector<uint8_t> realUsada; // constantes double referenciadas
+    vector<uint8_t> textoUsado;
+    vector<uint32_t> usos;     // usos de cada temporario
+
+    uint32_t chave(uint32_t opd) const {
+        if (opd == SEM_OPD) return SEM_OPD;
+        ClasseOperando c = classeOpd(opd);
+        if (c == OPD_VAR) return indiceOpd(opd);
+        if (c == OPD_TEMP) return numVars + indiceOpd(opd);
+        return SEM_OPD;
+    }
+
+    static bool chamaRuntime(OpTac op) {
+        return op == TAC_LEIA || op == TAC_ESCREVA;
+    }
+
+    static bool relacional(OpTac op) {
+        return op >= TAC_IGUAL && op <= TAC_MAIOR_IGUAL;
+    }
+
+    // Tipos de destino e fontes de uma instrucao (o campo 'tipo' e so um deles)
+    void tiposDe(size_t i, bool& dstReal, bool& srcReal) const {
+        OpTac op = tac.op[i];
+        bool real = tac.tipo[i] == V_DOUBLE;
+        dstReal = srcReal = real;
+        if (relacional(op)) dstReal = false;
+        if (op == TAC_PARA_REAL) srcReal = false, dstReal = true;
+    }
+
+    void alocaRegistradores() {
+        uint32_t n = numVars + tac.numTemps;
+        size_t total = tac.tamanho();
+        vector<uint32_t> inicio(n, UINT32_MAX), fim(n, 0);
+        vector<uint32_t> chamadas;
+        for (size_t i = 0; i < total; i++) {
+            bool dstReal, srcReal;
+            tiposDe(i, dstReal, srcReal);
+            if (chamaRuntime(tac.op[i])) chamadas.push_back((uint32_t)i);
+            auto marca = [&](uint32_t opd, bool real) {
+                uint32_t k = chave(opd);
+                if (k == SEM_OPD) return;
+                if (real) ehReal[k] = 1;
+                inicio[k] = min(inicio[k], (uint32_t)i);
+                fim[k] = max(fim[k], (uint32_t)i);
+            };
+            if (tac.op[i] != TAC_ROTULO && tac.op[i] != TAC_SALTO && tac.op[i] != TAC_SE_FALSO) marca(tac.dst[i], dstReal);
+            marca(tac.src1[i], srcReal);
+            marca(tac.src2[i], srcReal);
+        }
+
+        // Variaveis valem desde o inicio (comecam zeradas) e, se aparecem num laco,
+        // ate o salto de volta dele. Temporarios nao passam de um bloco
+        vector<uint32_t> posRotulo(tac.numRotulos, 0);
+        for (size_t i = 0; i < total; i++) {
+            if (tac.op[i] == TAC_ROTULO) posRotulo[indiceOpd(tac.dst[i])] = (uint32_t)i;
+        }
+        vector<pair<uint32_t, uint32_t>> lacos;
+        for (size_t i = 0; i < total; i++) {
+            if ((tac.op[i] == TAC_SALTO || tac.op[i] == TAC_SE_FALSO) && posRotulo[indiceOpd(tac.dst[i])] < i) {
+                lacos.push_back({posRotulo[indiceOpd(tac.dst[i])], (uint32_t)i});
+            }
+        }
+        for (uint32_t v = 0; v < numVars; v++) {
+            if (inicio[v] == UINT32_MAX) continue;
+            inicio[v] = 0;
+            for (bool mudou = true; mudou;) {
+                mudou = false;
+                for (auto& l : lacos) {
+                    if (fim[v] >= l.first && fim[v] < l.second) {
+                        fim[v] = l.second;
+                        mudou = true;
+                    }
+                }
+            }
+        }
+
+        vector<Intervalo> intervalos;
+        for (uint32_t k = 0; k < n; k++) {
+            if (inicio[k] != UINT32_MAX && !ehReal[k]) intervalos.push_back({k, inicio[k], fim[k]});
+        }
+        sort(intervalos.begin(), intervalos.end(), [](const Intervalo& a, const Intervalo& b) {
+            return a.inicio != b.inicio ? a.inicio < b.inicio : a.chave < b.chave;
+        });
+
+        auto cruzaChamada = [&](const Intervalo& it) {
+            auto p = upper_bound(chamadas.begin(), chamadas.end(), it.inicio);
+            return p != chamadas.end() && *p < it.fim;
+        };
+        vector<const Intervalo*> ativos;
+        bool livre[NUM_REGS];
+        fill(livre, livre + NUM_REGS, true);
+        for (const Intervalo& it : intervalos) {
+            for (size_t a = 0; a < ativos.size();) {
+                if (ativos[a]->fim < it.inicio) {
+                    livre[reg[ativos[a]->chave]] = true;
+                    ativos[a] = ativos.back();
+                    ativos.pop_back();
+                } else {
+                    a++;
+                }
+            }
+            int limite = cruzaChamada(it) ? NUM_PRESERVADOS : NUM_REGS;
+            int escolhido = -1;
+            // Sem chamada no meio, prefere os registradores que a runtime pode sujar
+            for (int r = limite - 1; r >= 0 && escolhido < 0; r--) {
+                if (livre[r]) escolhido = r;
+            }
+            if (escolhido < 0) {
+                // Sem registrador livre: vai para a memoria quem termina mais tarde
+                size_t vitima = SIZE_MAX;
+                for (size_t a = 0; a < ativos.size(); a++) {
+                    if (reg[ativos[a]->chave] < limite && (vitima == SIZE_MAX || ativos[a]->fim > ativos[vitima]->fim)) vitima = a;
+                }
+                if (vitima == SIZE_MAX || ativos[vitima]->fim <= it.fim) continue;
+                escolhido = reg[ativos[vitima]->chave];
+                reg[ativos[vitima]->chave] = -1;
+                ativos[vitima] = ativos.back();
+                ativos.pop_back();
+            }
+            livre[escolhido] = false;
+            reg[it.chave] = (int8_t)escolhido;
+            ativos.push_back(&it);
+        }
+    }
+
+    static bool cabe32(int64_t v) {
+        return v >= INT32_MIN && v <= INT32_MAX;
+    }
+
+    string rotulo(uint32_t opd) const {
+        return ".L" + to_string(indiceOpd(opd));
+    }
+
+    string casa(uint32_t k) {
+        naMemoria[k] = 1;
+        if (k < numVars) return ".Lv" + to_string(k) + "(%rip)";
+        return ".Lt" + to_string(k - numVars) + "(%rip)";
+    }
+
+    bool emRegistrador(uint32_t opd) const {
+        uint32_t k = chave(opd);
+        return k != SEM_OPD && reg[k] >= 0;
+    }
+
+    // Operando como aparece numa instrucao; constantes inteiras de 64 bits vao
+    // antes para o registrador de rascunho 'rasc', entao a linha que usa o
+    // operando so pode comecar a ser escrita depois desta chamada
+    string lugar(uint32_t opd, const char* rasc = "%rcx") {
+        uint32_t k = chave(opd);
+        if (k != SEM_OPD) return reg[k] >= 0 ? REGS[reg[k]] : casa(k);
+        const Constante& c = tac.constantes[indiceOpd(opd)];
+        if (c.tipo == V_DOUBLE) {
+            realUsada[indiceOpd(opd)] = 1;
+            return ".LC" + to_string(indiceOpd(opd)) + "(%rip)";
+        }
+        if (cabe32(c.inteiro)) return "$" + to_string(c.inteiro);
+        out << "    movabsq $" << c.inteiro << ", " << rasc << "\n";
+        return rasc;
+    }
+
+    void carrega(uint32_t opd, const string& r) {
+        string fonte = lugar(opd, r.c_str());
+        if (fonte != r) out << "    movq " << fonte << ", " << r << "\n";
+    }
+
+    void guarda(const char* r, uint32_t opd) {
+        out << "    movq " << r << ", " << lugar(opd) << "\n";
+    }
+
+    // dst := a op b para inteiros; calcula direto no registrador do destino quando da
+    void binario(const char* instr, size_t i) {
+        uint32_t d = tac.dst[i], a = tac.src1[i], b = tac.src2[i];
+        if (emRegistrador(d) && !(emRegistrador(b) && reg[chave(b)] == reg[chave(d)])) {
+            string rd = lugar(d);
+            carrega(a, rd);
+            string fb = lugar(b);
+            out << "    " << instr << " " << fb << ", " << rd << "\n";
+            return;
+        }
+        carrega(a, "%rax");
+        string fb = lugar(b);
+        out << "    " << instr << " " << fb << ", %rax\n";
+        guarda("%rax", d);
+    }
+
+    void divisao(size_t i, bool resto) {
+        carrega(tac.src1[i], "%rax");
+        carrega(tac.src2[i], "%rcx");
+        uint32_t b = tac.src2[i];
+        int64_t divisor = classeOpd(b) == OPD_CONST ? tac.constantes[indiceOpd(b)].inteiro : 0;
+        if (divisor != 0 && divisor != -1) {
+            out << "    cqto\n    idivq %rcx\n";
+            guarda(resto ? "%rdx" : "%rax", tac.dst[i]);
+            return;
+        }
+        out << "    testq %rcx, %rcx\n"
+            << "    je _pas_erro_div\n"
+            << "    cmpq $-1, %rcx\n"
+            << "    jne 1f\n"
+            << (resto ? "    xorl %edx, %edx\n" : "    negq %rax\n")
+            << "    jmp 2f\n"
+            << "1:  cqto\n"
+            << "    idivq %rcx\n"
+            << "2:\n";
+        guarda(resto ? "%rdx" : "%rax", tac.dst[i]);
+    }
+
+    void binarioReal(const char* instr, size_t i) {
+        out << "    movsd " << lugar(tac.src1[i]) << ", %xmm0\n";
+        out << "    " << instr << " " << lugar(tac.src2[i]) << ", %xmm0\n";
+        out << "    movsd %xmm0, " << lugar(tac.dst[i]) << "\n";
+    }
+
+    // Compara e deixa as flags prontas; devolve o sufixo de setcc/jcc que da verdadeiro
+    // ("" para '=' e '<>' com double, que precisam olhar a paridade)
+    string compara(size_t i) {
+        OpTac op = tac.op[i];
+        uint32_t a = tac.src1[i], b = tac.src2[i];
+        if (tac.tipo[i] != V_DOUBLE) {
+            string ra = emRegistrador(a) ? lugar(a) : "%rax";
+            carrega(a, ra);
+            string fb = lugar(b);
+            out << "    cmpq " << fb << ", " << ra << "\n";
+            static const char* const sufixo[] = {"e", "ne", "l", "g", "le", "ge"};
+            return sufixo[op - TAC_IGUAL];
+        }
+        // a < b vira b > a: com NaN so "acima" e "acima ou igual" dao falso
+        bool inverte = op == TAC_MENOR || op == TAC_MENOR_IGUAL;
+        out << "    movsd " << lugar(inverte ? b : a) << ", %xmm0\n";
+        out << "    ucomisd " << lugar(inverte ? a : b) << ", %xmm0\n";
+        if (op == TAC_MENOR || op == TAC_MAIOR) return "a";
+        if (op == TAC_MENOR_IGUAL || op == TAC_MAIOR_IGUAL) return "ae";
+        return "";
+    }
+
+    static string nega(const string& cc) {
+        static const pair<const char*, const char*> pares[] = {
+            {"e", "ne"}, {"ne", "e"}, {"l", "ge"}, {"g", "le"}, {"le", "g"}, {"ge", "l"}, {"a", "be"}, {"ae", "b"}
+        };
+        for (auto& p : pares) {
+            if (cc == p.first) return p.second;
+        }
+        return cc;
+    }
+
+    void relacao(size_t i) {
+        string cc = compara(i);
+        OpTac op = tac.op[i];
+        if (!cc.empty()) {
+            out << "    set" << cc << " %al\n";
+        } else if (op == TAC_IGUAL) {
+            out << "    sete %al\n    setnp %cl\n    andb %cl, %al\n";
+        } else {
+            out << "    setne %al\n    setp %cl\n    orb %cl, %al\n";
+        }
+        out << "    movzbl %al, %eax\n";
+        guarda("%rax", tac.dst[i]);
+    }
+
+    // Comparacao seguida do ifFalse que consome o resultado: salta direto
+    void relacaoESalto(size_t i, uint32_t alvo) {
+        string cc = compara(i);
+        OpTac op = tac.op[i];
+        string r = rotulo(alvo);
+        if (!cc.empty()) {
+            out << "    j" << nega(cc) << " " << r << "\n";
+        } else if (op == TAC_IGUAL) {
+            out << "    jne " << r << "\n    jp " << r << "\n";
+        } else {
+            out << "    jp 1f\n    je " << r << "\n1:\n";
+        }
+    }
+
+    void instrucao(size_t& i) {
+        OpTac op = tac.op[i];
+        bool real = tac.tipo[i] == V_DOUBLE;
+        uint32_t d = tac.dst[i], a = tac.src1[i];
+        switch (op) {
+            case TAC_ROTULO:
+                out << rotulo(d) << ":\n";
+                break;
+            case TAC_SALTO:
+                out << "    jmp " << rotulo(d) << "\n";
+                break;
+            case TAC_SE_FALSO:
+                if (classeOpd(a) == OPD_CONST) {
+                    if (!tac.constantes[indiceOpd(a)].inteiro) out << "    jmp " << rotulo(d) << "\n";
+                } else if (emRegistrador(a)) {
+                    out << "    testq " << lugar(a) << ", " << lugar(a) << "\n    je " << rotulo(d) << "\n";
+                } else {
+                    out << "    cmpq $0, " << lugar(a) << "\n    je " << rotulo(d) << "\n";
+                }
+                break;
+            case TAC_COPIA:
+                if (real) {
+                    out << "    movsd " << lugar(a) << ", %xmm0\n    movsd %xmm0, " << lugar(d) << "\n";
+                } else if (emRegistrador(d)) {
+                    carrega(a, lugar(d));
+                } else {
+                    carrega(a, "%rax");
+                    guarda("%rax", d);
+                }
+                break;
+            case TAC_PARA_REAL:
+                if (classeOpd(a) == OPD_CONST) {
+                    carrega(a, "%rax");
+                    out << "    cvtsi2sdq %rax, %xmm0\n";
+                } else {
+                    out << "    cvtsi2sdq " << lugar(a) << ", %xmm0\n";
+                }
+                out << "    movsd %xmm0, " << lugar(d) << "\n";
+                break;
+            case TAC_SOMA: real ? binarioReal("addsd", i) : binario("addq", i); break;
+            case TAC_SUB: real ? binarioReal("subsd", i) : binario("subq", i); break;
+            case TAC_MUL: real ? binarioReal("mulsd", i) : binario("imulq", i); break;
+            case TAC_BARRA: real ? binarioReal("divsd", i) : divisao(i, false); break;
+            case TAC_DIV: divisao(i, false); break;
+            case TAC_MOD: divisao(i, true); break;
+            case TAC_E: binario("andq", i); break;
+            case TAC_OU: binario("orq", i); break;
+            case TAC_NAO:
+                carrega(a, "%rax");
+                out << "    xorq $1, %rax\n";
+                guarda("%rax", d);
+                break;
+            case TAC_LEIA:
+                if (real) {
+                    out << "    call _pas_le_real\n    movsd %xmm0, " << lugar(d) << "\n";
+                } else {
+                    out << "    call " << (tac.tipo[i] == V_BOOLEAN ? "_pas_le_bool" : "_pas_le_int") << "\n";
+                    guarda("%rax", d);
+                }
+                break;
+            case TAC_ESCREVA:
+                if (real) {
+                    out << "    movsd " << lugar(a) << ", %xmm0\n    call _pas_escreve_real\n";
+                } else if (tac.tipo[i] == V_STRING) {
+                    textoUsado[indiceOpd(a)] = 1;
+                    out << "    leaq .LS" << indiceOpd(a) << "(%rip), %rdi\n    call _pas_escreve_str\n";
+                } else {
+                    carrega(a, "%rdi");
+                    out << "    call " << (tac.tipo[i] == V_BOOLEAN ? "_pas_escreve_bool" : "_pas_escreve_int") << "\n";
+                }
+                break;
+            default: {
+                // Relacionais. Strings sao so literais e ja chegam dobradas no -O1;
+                // no -O0 o resultado e calculado aqui
+                if (tac.tipo[i] == V_STRING) {
+                    Constante r;
+                    avaliaTac(op, V_STRING, tac.constantes[indiceOpd(a)], tac.constantes[indiceOpd(tac.src2[i])], r);
+                    out << "    movq $" << r.inteiro << ", %rax\n";
+                    guarda("%rax", d);
+                    break;
+                }
+                bool funde = i + 1 < tac.tamanho() && tac.op[i + 1] == TAC_SE_FALSO && tac.src1[i + 1] == d &&
+                             classeOpd(d) == OPD_TEMP && usos[indiceOpd(d)] == 1;
+                if (funde) {
+                    relacaoESalto(i, tac.dst[i + 1]);
+                    i++;
+                } else {
+                    relacao(i);
+                }
+            }
+        }
+    }
+
+    static string escapaTexto(string_view s) {
+        string r;
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                r += '\\';
+                r += (char)c;
+            } else if (c < 32 || c >= 127) {
+                char buf[8];
+                snprintf(buf, sizeof buf, "\\%03o", c);
+                r += buf;
+            } else {
+                r += (char)c;
+            }
+        }
+        return r;
+    }
+
+public:
+    GeradorAssembly(const CodigoIntermediario& c, const Internador& n, ostream& o)
+        : tac(c), nomes(n), numVars((uint32_t)n.tamanho()), out(o) {}
+
+    void gerar() {
+        uint32_t n = numVars + tac.numTemps;
+        reg.assign(n, -1);
+        ehReal.assign(n, 0);
+        naMemoria.assign(n, 0);
+        realUsada.assign(tac.constantes.size(), 0);
+        textoUsado.assign(tac.constantes.size(), 0);
+        usos.assign(tac.numTemps, 0);
+        for (size_t i = 0; i < tac.tamanho(); i++) {
+            for (uint32_t s : {tac.src1[i], tac.src2[i]}) {
+                if (s != SEM_OPD && classeOpd(s) == OPD_TEMP) usos[indiceOpd(s)]++;
+            }
+        }
+        alocaRegistradores();
+
+        out << "# Gerado pelo compilador Pascal a partir do codigo intermediario\n"
+            << "    .text\n    .globl main\n    .type main, @function\nmain:\n"
+            << "    pushq %rbp\n    movq %rsp, %rbp\n";
+        for (int r = 0; r < NUM_PRESERVADOS; r++) out << "    pushq " << REGS[r] << "\n";
+        out << "    subq $8, %rsp\n";
+        for (uint32_t v = 0; v < numVars; v++) {
+            if (reg[v] >= 0) out << "    xorl %eax, %eax\n    movq %rax, " << REGS[reg[v]] << "  # " << nomes.nome(v) << "\n";
+        }
+        for (size_t i = 0; i < tac.tamanho(); i++) instrucao(i);
+        out << "    addq $8, %rsp\n";
+        for (int r = NUM_PRESERVADOS; r-- > 0;) out << "    popq " << REGS[r] << "\n";
+        out << "    popq %rbp\n    xorl %eax, %eax\n    ret\n";
+        out << RUNTIME_ASM;
+
+        out << "\n    .section .rodata\n    .p2align 3\n";
+        for (size_t c = 0; c < tac.constantes.size(); c++) {
+            if (realUsada[c]) {
+                uint64_t bits;
+                memcpy(&bits, &tac.constantes[c].real, sizeof bits);
+                out << ".LC" << c << ":\n    .quad " << bits << "  # " << formataReal(tac.constantes[c].real) << "\n";
+            }
+        }
+        for (size_t c = 0; c < tac.constantes.size(); c++) {
+            if (textoUsado[c]) out << ".LS" << c << ":\n    .asciz \"" << escapaTexto(tac.constantes[c].texto) << "\"\n";
+        }
+        out << "\n    .bss\n    .p2align 3\n";
+        for (uint32_t k = 0; k < n; k++) {
+            if (!naMemoria[k]) continue;
+            if (k < numVars) out << ".Lv" << k << ":\n    .zero 8  # " << nomes.nome(k) << "\n";
+            else out << ".Lt" << (k - numVars) << ":\n    .zero 8\n";
+        }
+        out << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+    }
+};
+
+// Tabela de simbolos (tabela.txt): um token por linha, com lexema, tipo e linha
+// em colunas de 20, 25 e 10 caracteres. As linhas sao montadas num buffer, com os
+// numeros convertidos a mao, e vao para o arquivo em blocos de 1 MB. Um lexema ou
+// tipo que nao cabe na coluna ganha um espaco depois, para nao colar no seguinte
+class EscritorTabela {
+    static constexpr size_t TAM_BLOCO = 1 << 20;
+    static constexpr size_t COL_LEXEMA = 20, COL_TIPO = 25, COL_LINHA = 10;
+    FILE* arq = nullptr;
+    vector<char> buf;
+    size_t usado = 0;
+    bool ok = true;
+
+    void esvazia() {
+        if (usado && fwrite(buf.data(), 1, usado, arq) != usado) ok = false;
+        usado = 0;
+    }
+
+    void poe(const char* s, size_t n) {
+        if (usado + n > buf.size()) {
+            esvazia();
+            if (n > buf.size()) {
+                if (fwrite(s, 1, n, arq) != n) ok = false;
+                return;
+            }
+        }
+        memcpy(buf.data() + usado, s, n);
+        usado += n;
+    }
+
+    // 's' alinhado a esquerda numa coluna de 'largura'
+    void coluna(string_view s, size_t largura, bool separa = true) {
+        poe(s.data(), s.size());
+        size_t brancos = s.size() < largura ? largura - s.size() : separa;
+        if (usado + brancos > buf.size()) esvazia();
+        memset(buf.data() + usado, ' ', brancos);
+        usado += brancos;
+    }
+
+public:
+    EscritorTabela() = default;
+    EscritorTabela(const EscritorTabela&) = delete;
+    EscritorTabela& operator=(const EscritorTabela&) = delete;
+    ~EscritorTabela() { fecha(); }
+
+    bool abre(const string& caminho) {
+        arq = fopen(caminho.c_str(), "w");
+        if (!arq) return false;
+        setvbuf(arq, nullptr, _IONBF, 0); // o buffer e o nosso
+        buf.resize(TAM_BLOCO);
+        return true;
+    }
+
+    void cabecalho() {
+        coluna("Lexema", COL_LEXEMA);
+        coluna("Tipo", COL_TIPO);
+        coluna("Linha", COL_LINHA);
+        poe("\n", 1);
+        string traco(COL_LEXEMA + COL_TIPO + COL_LINHA, '-');
+        traco += '\n';
+        poe(traco.data(), traco.size());
+    }
+
+    void linha(string_view lexema, TipoToken tipo, uint64_t numLinha) {
+        coluna(lexema, COL_LEXEMA);
+        coluna(nomeTipoToken[tipo], COL_TIPO);
+        char num[20];
+        char* p = num + sizeof num;
+        do {
+            *--p = (char)('0' + numLinha % 10);
+            numLinha /= 10;
+        } while (numLinha);
+        coluna(string_view(p, num + sizeof num - p), COL_LINHA, false);
+        poe("\n", 1);
+    }
+
+    void linha(const Fonte& fonte, const Simbolo& simb) { linha(fonte.lexema(simb), simb.tipo, simb.linha); }
+
+    // Grava o que falta e fecha; false se alguma escrita falhou
+    bool fecha() {
+        if (!arq) return ok;
+        esvazia();
+        if (fclose(arq) != 0) ok = false;
+        arq = nullptr;
+        return ok;
+    }
+};
+
+// Arquivo binario de tokens (--tokens-bin), feito para ser mapeado e lido sem
+// analise: cabecalho, tokens, nomes dos identificadores (por id) e o texto.
+// Deslocamentos sao contados do inicio do arquivo e as secoes comecam alinhadas
+// a 8. O lexema de um token e texto[inicio, inicio + tamanho); tipo e sub sao os
+// valores de TipoToken e Sub. Inteiros na ordem de bytes da maquina que gravou
+// ('ordem' vale 0x01020304 nela)
+struct CabecalhoTokens {
+    char magico[8];
+    uint32_t versao;
+    uint32_t ordem;
+    uint32_t tamToken;
+    uint32_t tamNome;
+    uint64_t numTokens, inicioTokens;
+    uint64_t numNomes, inicioNomes;
+    uint64_t tamTexto, inicioTexto;
+};
+
+struct TokenBin {
+    uint64_t inicio;
+    uint64_t linha;
+    uint32_t tamanho;
+    uint32_t coluna;
+    uint32_t id;
+    uint8_t tipo;
+    uint8_t sub;
+    uint16_t reservado;
+};
+
+struct NomeBin {
+    uint64_t inicio; // no texto
+    uint32_t tamanho;
+    uint32_t reservado;
+};
+
+constexpr char MAGICO_TOKENS[8] = {'P', 'A', 'S', 'T', 'O', 'K', 'E', 'N'};
+constexpr uint32_t VERSAO_TOKENS = 1;
+static_assert(sizeof(CabecalhoTokens) == 72 && sizeof(TokenBin) == 32 && sizeof(NomeBin) == 16,
+              "o formato do arquivo de tokens nao pode ter enchimento");
+
+// Grava o arquivo de tokens a medida que eles passam; o texto, os nomes e o
+// cabecalho (que so entao tem as contagens) vao no fechamento
+class EscritorTokens {
+    static constexpr size_t TOKENS_POR_BLOCO = 1 << 15;
+    FILE* arq = nullptr;
+    vector<TokenBin> bloco;
+    vector<NomeBin> nomes;
+    uint64_t numTokens = 0;
+    bool ok = true;
+
+    void grava(const void* p, size_t n) {
+        if (n && fwrite(p, 1, n, arq) != n) ok = false;
+    }
+
+    void esvazia() {
+        grava(bloco.data(), bloco.size() * sizeof(TokenBin));
+        bloco.clear();
+    }
+
+    void alinha(uint64_t& pos) {
+        static const char zeros[8] = {};
+        size_t resto = (size_t)(-pos & 7);
+        grava(zeros, resto);
+        pos += resto;
+    }
+
+public:
+    EscritorTokens() = default;
+    EscritorTokens(const EscritorTokens&) = delete;
+    EscritorTokens& operator=(const EscritorTokens&) = delete;
+    ~EscritorTokens() {
+        if (arq) fclose(arq);
+    }
+
+    bool abre(const string& caminho) {
+        arq = fopen(caminho.c_str(), "wb");
+        if (!arq) return false;
+        CabecalhoTokens vazio{};
+        grava(&vazio, sizeof vazio); // reescrito no fechamento
+        bloco.reserve(TOKENS_POR_BLOCO);
+        return true;
+    }
+
+    void token(const Simbolo& s) {
+        bloco.push_back({s.inicio, s.linha, s.tamanho, s.coluna, s.id, s.tipo, s.sub, 0});
+        // Ids que o parser deu a tokens que nao sao identificadores ficam com tamanho 0
+        if (s.id != SEM_ID) {
+            if (s.id >= nomes.size()) nomes.resize(s.id + 1, NomeBin{0, 0, 0});
+            if (!nomes[s.id].tamanho) nomes[s.id] = {s.inicio, s.tamanho, 0};
+        }
+        numTokens++;
+        if (bloco.size() == TOKENS_POR_BLOCO) esvazia();
+    }
+
+    // Grava nomes, texto e cabecalho e fecha; false se alguma escrita falhou
+    bool fecha(const Fonte& fonte) {
+        if (!arq) return ok;
+        esvazia();
+        CabecalhoTokens c{};
+        memcpy(c.magico, MAGICO_TOKENS, sizeof c.magico);
+        c.versao = VERSAO_TOKENS;
+        c.ordem = 0x01020304;
+        c.tamToken = sizeof(TokenBin);
+        c.tamNome = sizeof(NomeBin);
+        c.numTokens = numTokens;
+        c.inicioTokens = sizeof(CabecalhoTokens);
+        uint64_t pos = c.inicioTokens + numTokens * sizeof(TokenBin);
+        c.numNomes = nomes.size();
+        c.inicioNomes = pos;
+        grava(nomes.data(), nomes.size() * sizeof(NomeBin));
+        pos += nomes.size() * sizeof(NomeBin);
+        c.inicioTexto = pos;
+        grava(fonte.texto().data(), fonte.texto().size());
+        grava(fonte.guardados().data(), fonte.guardados().size());
+        c.tamTexto = fonte.texto().size() + fonte.guardados().size();
+        pos += c.tamTexto;
+        alinha(pos);
+        if (fseek(arq, 0, SEEK_SET) != 0) ok = false;
+        grava(&c, sizeof c);
+        if (fclose(arq) != 0) ok = false;
+        arq = nullptr;
+        return ok;
+    }
+};
+
+// Arquivo de tokens mapeado (pela Fonte) e conferido; os acessos sao diretos
+class LeitorTokens {
+    Fonte arquivo;
+    CabecalhoTokens cab{};
+    const char* base = nullptr;
+
+    bool cabe(uint64_t inicio, uint64_t n, uint64_t tamanho) const {
+        uint64_t total = arquivo.texto().size();
+        return inicio <= total && n <= (total - inicio) / tamanho;
+    }
+
+public:
+    // Devolve o motivo se o arquivo nao serve, ou "" se abriu
+    string abrir(const string& caminho) {
+        if (!arquivo.abrir(caminho)) return "Nao abriu arquivo '" + caminho + "'";
+        string_view dados = arquivo.texto();
+        if (dados.size() < sizeof cab) return "Arquivo de tokens truncado";
+        memcpy(&cab, dados.data(), sizeof cab);
+        if (memcmp(cab.magico, MAGICO_TOKENS, sizeof cab.magico) != 0) return "Nao e um arquivo de tokens";
+        if (cab.ordem != 0x01020304) return "Arquivo de tokens gravado com outra ordem de bytes";
+        if (cab.versao != VERSAO_TOKENS || cab.tamToken != sizeof(TokenBin) || cab.tamNome != sizeof(NomeBin)) {
+            return "Versao " + to_string(cab.versao) + " do arquivo de tokens nao suportada";
+        }
+        if (!cabe(cab.inicioTokens, cab.numTokens, sizeof(TokenBin)) || !cabe(cab.inicioNomes, cab.numNomes, sizeof(NomeBin)) ||
+            !cabe(cab.inicioTexto, cab.tamTexto, 1) || cab.inicioTokens % 8 || cab.inicioNomes % 8) {
+            return "Arquivo de tokens corrompido";
+        }
+        base = dados.data();
+        return "";
+    }
+
+    uint64_t numTokens() const { return cab.numTokens; }
+    uint64_t numNomes() const { return cab.numNomes; }
+    const TokenBin* tokens() const { return (const TokenBin*)(base + cab.inicioTokens); }
+    const NomeBin* nomes() const { return (const NomeBin*)(base + cab.inicioNomes); }
+
+    // Texto de um token ou nome; vazio se sair do arquivo
+    string_view texto(uint64_t inicio, uint32_t tamanho) const {
+        if (inicio > cab.tamTexto || tamanho > cab.tamTexto - inicio) return {};
+        return {base + cab.inicioTexto + inicio, tamanho};
+    }
+};
+
+// Hash de 64 bits dos bytes (o XXH64); le 32 bytes por volta
+uint64_t hash64(const void* dados, size_t n, uint64_t semente = 0) {
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full, P3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull, P5 = 0x27D4EB2F165667C5ull;
+    auto rot = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto le64 = [](const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+    auto le32 = [](const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return (uint64_t)v; };
+    auto volta = [&](uint64_t acc, uint64_t v) { return rot(acc + v * P2, 31) * P1; };
+    auto junta = [&](uint64_t h, uint64_t acc) { return (h ^ volta(0, acc)) * P1 + P4; };
+
+    const unsigned char* p = (const unsigned char*)dados;
+    const unsigned char* fim = p + n;
+    uint64_t h;
+    if (n >= 32) {
+        uint64_t v1 = semente + P1 + P2, v2 = semente + P2, v3 = semente, v4 = semente - P1;
+        for (; p + 32 <= fim; p += 32) {
+            v1 = volta(v1, le64(p));
+            v2 = volta(v2, le64(p + 8));
+            v3 = volta(v3, le64(p + 16));
+            v4 = volta(v4, le64(p + 24));
+        }
+        h = rot(v1, 1) + rot(v2, 7) + rot(v3, 12) + rot(v4, 18);
+        h = junta(junta(junta(junta(h, v1), v2), v3), v4);
+    } else {
+        h = semente + P5;
+    }
+    h += n;
+    for (; p + 8 <= fim; p += 8) h = rot(h ^ volta(0, le64(p)), 27) * P1 + P4;
+    if (p + 4 <= fim) {
+        h = rot(h ^ (le32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < fim; p++) h = rot(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    return h ^ (h >> 32);
+}
+
+// Unidade compilada (--unidade): o que a analise de um programa sem erros apurou,
+// gravado para ser mapeado e usado direto, sem analise nem ajuste de ponteiros.
+// Secoes: texto (fonte, textos guardados, nomes e o caminho do fonte), nomes por
+// id, declaracoes da tabela de simbolos, nos da arvore e o inicio de cada linha
+// no texto. Filhos, irmaos e sombras sao indices nos proprios vetores. Mesmas
+// convencoes do arquivo de tokens; alem delas, 'verificacao' e o hash64 de tudo
+// depois do cabecalho, 'verificacaoCab' o do cabecalho (com ela zerada) e
+// 'hashFonte' o do fonte, para reconhecer uma unidade corrompida ou desatualizada
+struct CabecalhoUnidade {
+    char magico[8];
+    uint32_t versao;
+    uint32_t ordem;
+    uint32_t tamNo;
+    uint32_t tamDecl;
+    uint64_t verificacao;
+    uint64_t verificacaoCab;
+    uint64_t hashFonte, tamFonte;
+    uint32_t raiz;
+    uint32_t tamCaminho;
+    uint64_t inicioCaminho;      // no texto
+    uint64_t tamTexto, inicioTexto;
+    uint64_t numNomes, inicioNomes;
+    uint64_t numDecls, inicioDecls;
+    uint64_t numNos, inicioNos;
+    uint64_t numLinhas, inicioLinhas;
+};
+
+struct NoBin {
+    uint64_t inicio; // no texto
+    uint64_t linha;
+    uint32_t tamanho;
+    uint32_t id;
+    uint32_t filho;
+    uint32_t prox;
+    uint8_t tipo;    // Tipo
+    uint8_t classe;  // ClasseNo
+    uint8_t op;      // Sub
+    uint8_t reservado[5];
+};
+
+struct DeclBin {
+    uint32_t id;
+    uint32_t escopo;
+    uint32_t sombra; // declaracao que esta escondia; SEM_DECL se nenhuma
+    uint8_t tipo;
+    uint8_t reservado[3];
+};
+
+constexpr char MAGICO_UNIDADE[8] = {'P', 'A', 'S', 'U', 'N', 'I', 'D', 'A'};
+constexpr uint32_t VERSAO_UNIDADE = 1;
+static_assert(sizeof(CabecalhoUnidade) == 152 && sizeof(NoBin) == 40 && sizeof(DeclBin) == 16,
+              "o formato da unidade nao pode ter enchimento");
+
+// Monta a unidade na memoria (a verificacao precisa de tudo) e grava de uma vez;
+// false se a escrita falhou
+bool gravaUnidade(const string& caminho, const string& arquivoFonte, const Fonte& fonte, const Internador& nomes,
+                  const TabelaSimbolos& tabela, const Arvore& arvore) {
+    string dados;
+    auto secao = [&](const void* p, size_t n) {
+        uint64_t inicio = sizeof(CabecalhoUnidade) + dados.size();
+        dados.append((const char*)p, n);
+        dados.append((size_t)(-dados.size() & 7), '\0');
+        return inicio;
+    };
+    string_view texto = fonte.texto();
+    CabecalhoUnidade c{};
+    memcpy(c.magico, MAGICO_UNIDADE, sizeof c.magico);
+    c.versao = VERSAO_UNIDADE;
+    c.ordem = 0x01020304;
+    c.tamNo = sizeof(NoBin);
+    c.tamDecl = sizeof(DeclBin);
+    c.hashFonte = hash64(texto.data(), texto.size());
+    c.tamFonte = texto.size();
+    c.raiz = arvore.raiz;
+
+    // Texto: o fonte, os textos guardados (os nos apontam para os dois como nos
+    // tokens), depois os nomes e o caminho
+    string pool;
+    pool.reserve(texto.size() + fonte.guardados().size() + arquivoFonte.size());
+    pool.append(texto);
+    pool.append(fonte.guardados());
+    vector<NomeBin> nomesBin(nomes.tamanho());
+    for (uint32_t id = 0; id < nomesBin.size(); id++) {
+        string_view nome = nomes.nome(id);
+        nomesBin[id] = {pool.size(), (uint32_t)nome.size(), 0};
+        pool.append(nome);
+    }
+    c.inicioCaminho = pool.size();
+    c.tamCaminho = (uint32_t)arquivoFonte.size();
+    pool.append(arquivoFonte);
+    c.tamTexto = pool.size();
+    c.inicioTexto = secao(pool.data(), pool.size());
+    pool = string();
+
+    c.numNomes = nomesBin.size();
+    c.inicioNomes = secao(nomesBin.data(), nomesBin.size() * sizeof(NomeBin));
+
+    const vector<TabelaSimbolos::Declaracao>& decls = tabela.declaracoes();
+    vector<DeclBin> declsBin(decls.size());
+    for (size_t k = 0; k < decls.size(); k++) {
+        declsBin[k] = {decls[k].id, decls[k].escopo, decls[k].sombra, decls[k].tipo, {}};
+    }
+    c.numDecls = declsBin.size();
+    c.inicioDecls = secao(declsBin.data(), declsBin.size() * sizeof(DeclBin));
+
+    vector<NoBin> nosBin(arvore.nos.tamanho());
+    for (uint32_t k = 0; k < nosBin.size(); k++) {
+        const No& n = arvore.nos[k];
+        nosBin[k] = {n.inicio, n.linha, n.tamanho, n.id, n.filho, n.prox, n.tipo, n.classe, n.op, {}};
+    }
+    c.numNos = nosBin.size();
+    c.inicioNos = secao(nosBin.data(), nosBin.size() * sizeof(NoBin));
+
+    vector<uint64_t> linhas{0};
+    for (const char* p = texto.data(); (p = (const char*)memchr(p, '\n', texto.data() + texto.size() - p)); p++) {
+        linhas.push_back((uint64_t)(p + 1 - texto.data()));
+    }
+    c.numLinhas = linhas.size();
+    c.inicioLinhas = secao(linhas.data(), linhas.size() * sizeof(uint64_t));
+
+    c.verificacao = hash64(dados.data(), dados.size());
+    c.verificacaoCab = hash64(&c, sizeof c);
+    FILE* arq = fopen(caminho.c_str(), "wb");
+    if (!arq) return false;
+    bool ok = fwrite(&c, sizeof c, 1, arq) == 1 && fwrite(dados.data(), 1, dados.size(), arq) == dados.size();
+    return fclose(arq) == 0 && ok;
+}
+
+// Unidade mapeada (pela Fonte). Abrir confere so o cabecalho e custa o mesmo para
+// qualquer tamanho; confere() le o conteudo inteiro e e para quem nao confia no
+// arquivo. Depois disso os acessos sao diretos no mapeamento
+class LeitorUnidade {
+    Fonte arquivo;
+    CabecalhoUnidade cab{};
+    const char* base = nullptr;
+
+    bool cabe(uint64_t inicio, uint64_t n, uint64_t tamanho) const {
+        uint64_t total = arquivo.texto().size();
+        return inicio <= total && n <= (total - inicio) / tamanho && inicio % 8 == 0;
+    }
+
+public:
+    // Devolve o motivo se a unidade nao serve, ou "" se abriu
+    string abrir(const string& caminho) {
+        if (!arquivo.abrir(caminho)) return "Nao abriu arquivo '" + caminho + "'";
+        string_view dados = arquivo.texto();
+        if (dados.size() < sizeof cab) return "Unidade truncada";
+        memcpy(&cab, dados.data(), sizeof cab);
+        if (memcmp(cab.magico, MAGICO_UNIDADE, sizeof cab.magico) != 0) return "Nao e uma unidade compilada";
+        if (cab.ordem != 0x01020304) return "Unidade gravada com outra ordem de bytes";
+        if (cab.versao != VERSAO_UNIDADE || cab.tamNo != sizeof(NoBin) || cab.tamDecl != sizeof(DeclBin)) {
+            return "Versao " + to_string(cab.versao) + " da unidade nao suportada";
+        }
+        CabecalhoUnidade zerado = cab;
+        zerado.verificacaoCab = 0;
+        if (hash64(&zerado, sizeof zerado) != cab.verificacaoCab) return "Unidade corrompida";
+        if (!cabe(cab.inicioTexto, cab.tamTexto, 1) || !cabe(cab.inicioNomes, cab.numNomes, sizeof(NomeBin)) ||
+            !cabe(cab.inicioDecls, cab.numDecls, sizeof(DeclBin)) || !cabe(cab.inicioNos, cab.numNos, sizeof(NoBin)) ||
+            !cabe(cab.inicioLinhas, cab.numLinhas, sizeof(uint64_t)) || cab.inicioCaminho > cab.tamTexto ||
+            cab.tamCaminho > cab.tamTexto - cab.inicioCaminho) {
+            return "Unidade corrompida";
+        }
+        base = dados.data();
+        return "";
+    }
+
+    bool confere() const {
+        string_view dados = arquivo.texto();
+        return hash64(dados.data() + sizeof cab, dados.size() - sizeof cab) == cab.verificacao;
+    }
+
+    // O fonte ainda e o que gerou a unidade
+    bool atual(string_view fonte) const {
+        return fonte.size() == cab.tamFonte && hash64(fonte.data(), fonte.size()) == cab.hashFonte;
+    }
+
+    uint64_t numNomes() const { return cab.numNomes; }
+    uint64_t numDecls() const { return cab.numDecls; }
+    uint64_t numNos() const { return cab.numNos; }
+    uint64_t numLinhas() const { return cab.numLinhas; }
+    uint32_t raiz() const { return cab.raiz; }
+    const NomeBin* nomes() const { return (const NomeBin*)(base + cab.inicioNomes); }
+    const DeclBin* decls() const { return (const DeclBin*)(base + cab.inicioDecls); }
+    const NoBin* nos() const { return (const NoBin*)(base + cab.inicioNos); }
+    const uint64_t* linhas() const { return (const uint64_t*)(base + cab.inicioLinhas); }
+    string_view caminhoFonte() const { return texto(cab.inicioCaminho, cab.tamCaminho); }
+
+    // Texto de um no ou nome; vazio se sair do arquivo
+    string_view texto(uint64_t inicio, uint32_t tamanho) const {
+        if (inicio > cab.tamTexto || tamanho > cab.tamTexto - inicio) return {};
+        return {base + cab.inicioTexto + inicio, tamanho};
+    }
+
+    string_view nome(uint32_t id) const {
+        return id < cab.numNomes ? texto(nomes()[id].inicio, nomes()[id].tamanho) : string_view();
+    }
+};
+
+// Mostra no maximo 'maximo' mensagens no total, nesta ordem; o resto so e contado
+bool relataErros(ostream& rel, const Diagnosticos& errosLex, const Diagnosticos& errosSint, const Diagnosticos& errosSem,
+                 size_t maximo = SIZE_MAX) {
+    auto secao = [&](const char* titulo, const Diagnosticos& erros) {
+        if (erros.vazio()) return;
+        rel << titulo;
+        size_t n = min(maximo, erros.tamanho());
+        for (size_t i = 0; i < n; i++) rel << erros.mensagem(i);
+        maximo -= n;
+        uint64_t ocultos = erros.tamanho() - n + erros.getOmitidos();
+        if (ocultos) rel << "... e mais " << ocultos << " erros (--max-erros)\n";
+        if (erros.getRepetidos()) rel << "(" << erros.getRepetidos() << " mensagens repetidas omitidas)\n";
+    };
+
+    secao("\n- Erros Lexicos Encontrados -\n", errosLex);
+
+    rel << "\n- Iniciando Analise Sintatica e Semantica -\n";
+
+    secao("\n- Erros Sintaticos Encontrados -\n", errosSint);
+    secao("\n- Erros Semanticos Encontrados -\n", errosSem);
+    return errosLex.vazio() && errosSint.vazio() && errosSem.vazio();
+}
+
+// Texto como string JSON, com aspas
+string textoJson(string_view s) {
+    string r = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            r += '\\';
+            r += (char)c;
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof esc, "\\u%04x", c);
+            r += esc;
+        } else {
+            r += (char)c;
+        }
+    }
+    return r + "\"";
+}
+
+// Valor JSON lido de um pedido do servidor. Numeros guardam o texto original
+// (o id volta igual na resposta); objetos sao pares em ordem
+struct Json {
+    enum Tipo : uint8_t { NULO, BOOLEANO, NUMERO, TEXTO, LISTA, OBJETO } tipo = NULO;
+    bool booleano = false;
+    string texto;
+    vector<Json> itens;
+    vector<string> chaves; // uma por item, nos objetos
+
+    const Json* campo(string_view chave) const {
+        if (tipo != OBJETO) return nullptr;
+        for (size_t k = 0; k < chaves.size(); k++) {
+            if (chaves[k] == chave) return &itens[k];
+        }
+        return nullptr;
+    }
+
+    // O valor reescrito em JSON (so para ids: nulo, numero ou texto)
+    string id() const {
+        if (tipo == NUMERO) return texto;
+        if (tipo == TEXTO) return textoJson(texto);
+        return "null";
+    }
+};
+
+// Leitor recursivo de JSON (RFC 8259). A profundidade e limitada para um pedido
+// malformado nao estourar a pilha
+class LeitorJson {
+    static constexpr int PROFUNDIDADE_MAX = 256;
+    string_view s;
+    size_t i = 0;
+
+    void espacos() {
+        while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r')) i++;
+    }
+
+    bool literal(string_view palavra) {
+        if (s.substr(i, palavra.size()) != palavra) return false;
+        i += palavra.size();
+        return true;
+    }
+
+    bool hex4(unsigned& v) {
+        if (i + 4 > s.size()) return false;
+        v = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = s[i++];
+            int d = isdigit((unsigned char)c) ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+            if (d < 0) return false;
+            v = v * 16 + (unsigned)d;
+        }
+        return true;
+    }
+
+    static void utf8(string& r, unsigned cp) {
+        if (cp < 0x80) {
+            r += (char)cp;
+        } else if (cp < 0x800) {
+            r += (char)(0xC0 | cp >> 6);
+            r += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            r += (char)(0xE0 | cp >> 12);
+            r += (char)(0x80 | (cp >> 6 & 0x3F));
+            r += (char)(0x80 | (cp & 0x3F));
+        } else {
+            r += (char)(0xF0 | cp >> 18);
+            r += (char)(0x80 | (cp >> 12 & 0x3F));
+            r += (char)(0x80 | (cp >> 6 & 0x3F));
+            r += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool texto(string& r) {
+        i++; // '"'
+        for (;;) {
+            size_t j = i;
+            while (j < s.size() && s[j] != '"' && s[j] != '\\' && (unsigned char)s[j] >= 0x20) j++;
+            r.append(s.substr(i, j - i));
+            i = j;
+            if (i >= s.size() || (unsigned char)s[i] < 0x20) return false;
+            if (s[i++] == '"') return true;
+            if (i >= s.size()) return false;
+            char c = s[i++];
+            switch (c) {
+                case '"': case '\\': case '/': r += c; break;
+                case 'b': r += '\b'; break;
+                case 'f': r += '\f'; break;
+                case 'n': r += '\n'; break;
+                case 'r': r += '\r'; break;
+                case 't': r += '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if (!hex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        unsigned baixo;
+                        if (!literal("\\u") || !hex4(baixo) || baixo < 0xDC00 || baixo >= 0xE000) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (baixo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp < 0xE000) {
+                        return false;
+                    }
+                    utf8(r, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+    }
+
+    bool numero(string& r) {
+        size_t j = i;
+        if (j < s.size() && s[j] == '-') j++;
+        size_t digitos = j;
+        while (j < s.size() && isdigit((unsigned char)s[j])) j++;
+        if (j == digitos || (s[digitos] == '0' && j > digitos + 1)) return false;
+        if (j < s.size() && s[j] == '.') {
+            size_t frac = ++j;
+            while (j < s.size() && isdigit((unsigned char)s[j])) j++;
+            if (j == frac) return false;
+        }
+        if (j < s.size() && (s[j] == 'e' || s[j] == 'E')) {
+            j++;
+            if (j < s.size() && (s[j] == '+' || s[j] == '-')) j++;
+            size_t exp = j;
+            while (j < s.size() && isdigit((unsigned char)s[j])) j++;
+            if (j == exp) return false;
+        }
+        r.assign(s.substr(i, j - i));
+        i = j;
+        return true;
+    }
+
+    bool valor(Json& v, int profundidade) {
+        espacos();
+        if (i >= s.size() || profundidade > PROFUNDIDADE_MAX) return false;
+        char c = s[i];
+        if (c == '{' || c == '[') {
+            char fecha = c == '{' ? '}' : ']';
+            v.tipo = c == '{' ? Json::OBJETO : Json::LISTA;
+            i++;
+            espacos();
+            if (i < s.size() && s[i] == fecha) {
+                i++;
+                return true;
+            }
+            for (;;) {
+                if (v.tipo == Json::OBJETO) {
+                    espacos();
+                    v.chaves.emplace_back();
+                    if (i >= s.size() || s[i] != '"' || !texto(v.chaves.back())) return false;
+                    espacos();
+                    if (i >= s.size() || s[i++] != ':') return false;
+                }
+                v.itens.emplace_back();
+                if (!valor(v.itens.back(), profundidade + 1)) return false;
+                espacos();
+                if (i >= s.size()) return false;
+                if (s[i] == fecha) {
+                    i++;
+                    return true;
+                }
+                if (s[i++] != ',') return false;
+            }
+        }
+        if (c == '"') {
+            v.tipo = Json::TEXTO;
+            return texto(v.texto);
+        }
+        if (c == '-' || isdigit((unsigned char)c)) {
+            v.tipo = Json::NUMERO;
+            return numero(v.texto);
+        }
+        if (literal("true") || literal("false")) {
+            v.tipo = Json::BOOLEANO;
+            v.booleano = c == 't';
+            return true;
+        }
+        return literal("null");
+    }
+
+public:
+    // Le o texto inteiro como um valor; devolve false se nao for JSON valido
+    bool le(string_view texto, Json& v) {
+        s = texto;
+        i = 0;
+        v = Json();
+        if (!valor(v, 0)) return false;
+        espacos();
+        return i == s.size();
+    }
+};
+
+// Lista "diagnosticos" em JSON, seguida de "omitidos" e "repetidos", na ordem e com o
+// limite do relatorio. Compacta, sai numa linha so (servidor)
+void escreveDiagnosticosJson(ostream& saida, const Diagnosticos& errosLex, const Diagnosticos& errosSint,
+                             const Diagnosticos& errosSem, size_t maximo, bool compacta) {
+    const char* item = compacta ? "" : "\n    ";
+    saida << "\"diagnosticos\": [";
+    bool primeiro = true;
+    uint64_t omitidos = 0, repetidos = 0;
+    for (const Diagnosticos* lista : {&errosLex, &errosSint, &errosSem}) {
+        size_t n = min(maximo, lista->tamanho());
+        for (size_t i = 0; i < n; i++) {
+            const Diagnosticos::Diagnostico& d = (*lista)[i];
+            const InfoDiag& info = infoDiag[d.codigo];
+            saida << (primeiro ? "" : compacta ? ", " : ",") << item << "{\"codigo\": \"" << info.codigo << "\", \"gravidade\": \""
+                  << nomeGravidade[info.gravidade] << "\", \"fase\": \"" << nomeFaseDiag[info.fase] << "\", \"linha\": ";
+            if (info.comLinha) saida << d.linha;
+            else saida << "null";
+            saida << ", \"coluna\": " << d.coluna << ", \"mensagem\": " << textoJson(lista->corpo(d)) << ", \"argumentos\": [";
+            for (int k = 0; k < d.numArgs; k++) saida << (k ? ", " : "") << textoJson(lista->arg(d, k));
+            saida << "]}";
+            primeiro = false;
+        }
+        maximo -= n;
+        omitidos += lista->tamanho() - n + lista->getOmitidos();
+        repetidos += lista->getRepetidos();
+    }
+    saida << (primeiro || compacta ? "" : "\n  ") << "]," << (compacta ? " " : "\n  ") << "\"omitidos\": " << omitidos << ","
+          << (compacta ? " " : "\n  ") << "\"repetidos\": " << repetidos;
+}
+
+// Diagnosticos em JSON (--diagnosticos-json)
+void gravaDiagnosticosJson(ostream& saida, const string& arquivo, const Diagnosticos& errosLex,
+                           const Diagnosticos& errosSint, const Diagnosticos& errosSem, size_t maximo = SIZE_MAX) {
+    saida << "{\n  \"arquivo\": " << textoJson(arquivo) << ",\n  ";
+    escreveDiagnosticosJson(saida, errosLex, errosSint, errosSem, maximo, false);
+    saida << "\n}\n";
+}
+
+// Eventos do --trace no formato Trace Event do Chrome (chrome://tracing, Perfetto).
+// Cada arquivo compilado ganha uma linha do tempo propria; no lote as threads
+// entregam os seus eventos ao mesmo tempo
+class Rastro {
+    mutex m;
+    string eventos;
+    unsigned linhas = 0;
+    Medidor::Relogio::time_point inicio = Medidor::Relogio::now();
+
+    static string numero(double v) {
+        char buf[32];
+        snprintf(buf, sizeof buf, "%.3f", v);
+        return buf;
+    }
+
+public:
+    void adiciona(const Medidor& med, const string& arquivo) {
+        lock_guard<mutex> trava(m);
+        string tid = to_string(++linhas);
+        string cab = "{\"pid\":1,\"tid\":" + tid + ",";
+        double base = chrono::duration<double, micro>(med.getInicio() - inicio).count();
+        if (!eventos.empty()) eventos += ",\n";
+        eventos += cab + "\"ph\":\"M\",\"name\":\"thread_name\",\"args\":{\"name\":" + textoJson(arquivo) + "}}";
+        for (const Medidor::Evento& e : med.getEventos()) {
+            eventos += ",\n" + cab + "\"ph\":\"X\",\"cat\":\"fase\",\"name\":" + textoJson(infoFase[e.fase].nome) +
+                       ",\"ts\":" + numero(base + e.inicioUs) + ",\"dur\":" + numero(e.duracaoUs) +
+                       ",\"args\":{\"alocacoes\":" + to_string(e.alocacoes) + "}}";
+        }
+        // Totais das fases finas (por token) e os contadores, no fim da linha do tempo
+        string fim = numero(base + med.decorridoUs());
+        eventos += ",\n" + cab + "\"ph\":\"C\",\"name\":\"ms por fase\",\"ts\":" + fim + ",\"args\":{";
+        bool primeiro = true;
+        for (int f = 0; f < NUM_FASES; f++) {
+            if (!med.fase((IdFase)f).chamadas) continue;
+            eventos += (primeiro ? "" : ",") + textoJson(infoFase[f].nome) + ":" + numero(med.fase((IdFase)f).segundos * 1000);
+            primeiro = false;
+        }
+        eventos += "}},\n" + cab + "\"ph\":\"C\",\"name\":\"contadores\",\"ts\":" + fim + ",\"args\":{";
+        for (int c = 0; c < NUM_CONTADORES; c++) {
+            eventos += (c ? "," : "") + textoJson(nomeContador[c]) + ":" + to_string(med.contador((IdContador)c));
+        }
+        eventos += "}}";
+    }
+
+    bool grava(const string& caminho) {
+        lock_guard<mutex> trava(m);
+        ofstream saida(caminho, ios::binary);
+        saida << "{\"traceEvents\":[\n" << eventos << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return (bool)saida;
+    }
+};
+
+struct Opcoes {
+    bool gravaTabela = true;
+    bool gravaCodigo = true;
+    bool mostraEstatisticas = false;
+    bool executar = false;
+    bool geraAssembly = false;
+    int nivelOtimizacao = 1;
+    bool diagnosticosJson = false;
+    bool gravaTokens = false;   // --tokens-bin
+    bool gravaUnidade = false;  // --unidade
+    unsigned threadsLexico = 1; // threads para ler um arquivo grande
+    LimiteDiag limiteErros;
+    uint32_t maxProfundidade = PROFUNDIDADE_PADRAO;
+    Rastro* rastro = nullptr;   // --trace
+};
+
+// Arquivos gerados para uma entrada
+struct Saidas {
+    string tabela = "tabela.txt";
+    string intermediario = "intermediario.txt";
+    string assembly = "programa.s";
+    string diagnosticos = "diagnosticos.json";
+    string tokens = "tokens.bin";
+    string unidade = "unidade.bin";
+};
+
+// Compila um arquivo do inicio ao fim, com o relatorio em 'rel'. Nao usa estado
+// global, entao varios arquivos podem ser compilados ao mesmo tempo.
+// Devolve o codigo de saida do processo; 'semErros' diz se o programa passou nas analises
+int compilaArquivo(const string& arquivo, const Saidas& saidas, const Opcoes& op, ostream& rel, bool& semErros) {
+    semErros = false;
+    Fonte fonte;
+    Internador nomes;
+    Arvore arvore;
+    Medidor medidor(op.rastro != nullptr);
+    Medidor* med = instrumentado && (op.mostraEstatisticas || op.rastro) ? &medidor : nullptr;
+    bool abriu;
+    {
+        MedeFase fase(med, F_LEITURA);
+        abriu = fonte.abrir(arquivo);
+    }
+
+    EscritorTabela tabela;
+    if (op.gravaTabela) {
+        if (!tabela.abre(saidas.tabela)) {
+            cerr << "Erro: Nao abriu arquivo de saida '" << saidas.tabela << "'\n";
+            return 1;
+        }
+        tabela.cabecalho();
+    }
+    string msgTabela = op.gravaTabela ? " Tabela de simbolos salva em '" + saidas.tabela + "'." : "";
+
+    if (!abriu) {
+        Diagnosticos erro;
+        erro.emite(L_ARQUIVO, 0, 0, {arquivo});
+        rel << "Analise lexica terminada." << msgTabela << "\n";
+        rel << "\n- Erros Lexicos Encontrados -\n";
+        rel << erro.mensagem(0);
+        if (op.diagnosticosJson) {
+            ofstream arqDiag(saidas.diagnosticos);
+            gravaDiagnosticosJson(arqDiag, arquivo, erro, Diagnosticos(), Diagnosticos());
+        }
+        return 1;
+    }
+
+    EscritorTokens tokensBin;
+    if (op.gravaTokens && !tokensBin.abre(saidas.tokens)) {
+        cerr << "Erro: Nao abriu arquivo de saida '" << saidas.tokens << "'\n";
+        return 1;
+    }
+
+    // O parser puxa os tokens do lexico; a tabela e gravada a medida que eles passam
+    Lexico lexico(fonte, nomes);
+    lexico.instrumenta(med);
+    lexico.configuraErros(op.limiteErros);
+    lexico.preparaParalelo(op.threadsLexico);
+    function<void(const Simbolo&)> tee;
+    if (op.gravaTabela || op.gravaTokens) {
+        tee = [&](const Simbolo& simb) {
+            MedeFase fase(med, F_TABELA);
+            if (op.gravaTabela) tabela.linha(fonte, simb);
+            if (op.gravaTokens) tokensBin.token(simb);
+        };
+    }
+    FluxoTokens fluxo(lexico, tee);
+    Sintatico sint(fluxo, fonte, nomes, arvore);
+    sint.instrumenta(med);
+    sint.configuraErros(op.limiteErros);
+    sint.limitaProfundidade(op.maxProfundidade);
+    sint.analisar();
+    fluxo.esgota();
+    {
+        MedeFase fase(med, F_TABELA);
+        if (op.gravaTabela && !tabela.fecha()) {
+            cerr << "Erro: Falha ao gravar '" << saidas.tabela << "'\n";
+            return 1;
+        }
+        if (op.gravaTokens && !tokensBin.fecha(fonte)) {
+            cerr << "Erro: Falha ao gravar '" << saidas.tokens << "'\n";
+            return 1;
+        }
+    }
+
+    const Diagnosticos& errosLex = lexico.getErros();
+    const Diagnosticos& errosSint = sint.getErrosSintaticos();
+    const Diagnosticos& errosSem = sint.getErrosSemanticos();
+
+    // Com --stats ou --trace, as medicoes saem em qualquer retorno daqui em diante
+    auto termina = [&](int codigo) {
+        if (med) {
+            med->conta(C_TOKENS, fluxo.total());
+            med->conta(C_DIAGNOSTICOS, errosLex.total() + errosSint.total() + errosSem.total());
+            if (op.mostraEstatisticas) med->relata(rel);
+            if (op.rastro) op.rastro->adiciona(*med, arquivo);
+        }
+        return codigo;
+    };
+
+    rel << "Analise lexica terminada." << msgTabela << "\n";
+
+    if (op.diagnosticosJson) {
+        ofstream arqDiag(saidas.diagnosticos);
+        if (!arqDiag.is_open()) {
+            cerr << "Erro: Nao abriu arquivo de saida '" << saidas.diagnosticos << "'\n";
+            return termina(1);
+        }
+        gravaDiagnosticosJson(arqDiag, arquivo, errosLex, errosSint, errosSem, op.limiteErros.maximo);
+    }
+
+    if (relataErros(rel, errosLex, errosSint, errosSem, op.limiteErros.maximo)) {
+        semErros = true;
+        rel << "\nAnalises lexica, sintatica e semantica concluidas sem erros.\n";
+
+        if (op.gravaUnidade) {
+            MedeFase fase(med, F_TABELA);
+            if (!gravaUnidade(saidas.unidade, arquivo, fonte, nomes, sint.getTabelaSimbolos(), arvore)) {
+                cerr << "Erro: Falha ao gravar '" << saidas.unidade << "'\n";
+                return termina(1);
+            }
+            rel << "Unidade compilada salva em '" << saidas.unidade << "'.\n";
+        }
+
+        CodigoIntermediario codigo;
+        {
+            MedeFase fase(med, F_INTERMEDIARIO);
+            GeradorIntermediario(arvore, fonte, codigo).gerar();
+        }
+        size_t geradas = codigo.tamanho();
+        Otimizador otimizador(codigo, (uint32_t)nomes.tamanho());
+        {
+            MedeFase fase(med, F_OTIMIZACAO);
+            otimizador.otimizar(op.nivelOtimizacao);
+        }
+        if (op.mostraEstatisticas) {
+            rel << "\n- Otimizacao -O" << op.nivelOtimizacao << ": " << geradas << " -> " << codigo.tamanho() << " instrucoes -\n";
+            for (const auto& e : otimizador.getEstatisticas()) {
+                if (!e.execucoes) continue;
+                rel << left << setw(24) << e.nome << e.execucoes << " execucoes, " << e.mudancas << " mudancas, "
+                    << e.removidas << " instrucoes removidas, " << fixed << setprecision(3) << e.ms << " ms\n";
+            }
+        }
+        if (op.gravaCodigo) {
+            ofstream arqCodigo(saidas.intermediario);
+            if (!arqCodigo.is_open()) {
+                cerr << "Erro: Nao abriu arquivo de saida '" << saidas.intermediario << "'\n";
+                return termina(1);
+            }
+            MedeFase fase(med, F_INTERMEDIARIO);
+            gravaIntermediario(codigo, nomes, arqCodigo);
+            rel << "Codigo intermediario (" << codigo.tamanho() << " instrucoes) salvo em '" << saidas.intermediario << "'.\n";
+        }
+        if (op.geraAssembly) {
+            ofstream arqAsm(saidas.assembly);
+            if (!arqAsm.is_open()) {
+                cerr << "Erro: Nao abriu arquivo de saida '" << saidas.assembly << "'\n";
+                return termina(1);
+            }
+            MedeFase fase(med, F_ASSEMBLY);
+            GeradorAssembly(codigo, nomes, arqAsm).gerar();
+            rel << "Assembly x86-64 salvo em '" << saidas.assembly << "' (monte com: cc " << saidas.assembly << ").\n";
+        }
+        if (op.executar) {
+            bool ok;
+            ProgramaVM programa = traduzVM(codigo, (uint32_t)nomes.tamanho());
+            MaquinaVirtual vm(programa, cin, rel);
+            rel << "\n- Execucao -\n";
+            {
+                MedeFase fase(med, F_EXECUCAO);
+                ok = vm.executa();
+            }
+            rel << "\n";
+            if (!ok) {
+                rel << "Erro de execucao: " << vm.getErro() << ".\n";
+                return termina(1);
+            }
+        }
+    }
+
+    return termina(0);
+}
+
+// Muda a cada build: entradas de outro compilador nunca sao aproveitadas
+constexpr const char* VERSAO_COMPILADOR = "compilador " __DATE__ " " __TIME__;
+
+// Cache em disco dos resultados da compilacao, indexado pelo hash do fonte, da
+// versao do compilador e das opcoes. Cada entrada e um arquivo '<chave>.cache' com
+// o relatorio e os arquivos gerados; e escrita num temporario e renomeada, entao
+// varios processos podem usar o mesmo diretorio. A data de modificacao marca o
+// ultimo uso, e 'limpa' remove as mais antigas quando o total passa do limite
+class CacheCompilacao {
+    static constexpr uint32_t MAGICO = 0x31434350; // "PCC1"
+    static constexpr int NUM_ARTEFATOS = 6;        // tabela, intermediario, assembly, diagnosticos, tokens, unidade
+
+    string dir;
+    uint64_t limite;
+    atomic<uint64_t> acertos{0}, faltas{0}, gravadas{0}, removidas{0};
+    atomic<uint64_t> temporarios{0};
+    uint64_t instancia; // distingue os temporarios de processos que dividem o diretorio
+
+    string caminho(uint64_t chave) const {
+        char nome[32];
+        snprintf(nome, sizeof nome, "%016llx.cache", (unsigned long long)chave);
+        return dir + "/" + nome;
+    }
+
+    static void gravaTexto(string& dados, const string& s) {
+        uint64_t n = s.size();
+        dados.append((const char*)&n, 8);
+        dados += s;
+    }
+
+    static bool leTexto(string_view& dados, string& s) {
+        uint64_t n;
+        if (dados.size() < 8) return false;
+        memcpy(&n, dados.data(), 8);
+        if (dados.size() - 8 < n) return false;
+        s.assign(dados.substr(8, n));
+        dados.remove_prefix(8 + n);
+        return true;
+    }
+
+    static bool leArquivo(const string& arquivo, string& s) {
+        ifstream arq(arquivo, ios::binary);
+        if (!arq.is_open()) return false;
+        s.assign(istreambuf_iterator<char>(arq), istreambuf_iterator<char>());
+        return true;
+    }
+
+    static bool gravaArquivo(const string& arquivo, const string& s) {
+        ofstream arq(arquivo, ios::binary);
+        if (!arq.is_open()) return false;
+        arq.write(s.data(), (streamsize)s.size());
+        return (bool)arq;
+    }
+
+public:
+    CacheCompilacao(string dir, uint64_t limite) : dir(move(dir)), limite(limite) {
+        random_device aleatorio;
+        uint64_t agora = (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+        instancia = ((uint64_t)aleatorio() << 32 | aleatorio()) ^ hash64(&agora, sizeof agora);
+        error_code ec;
+        filesystem::create_directories(this->dir, ec);
+    }
+
+    // Chave do arquivo com estas opcoes e saidas; false se o fonte nao abre
+    bool chave(const string& arquivo, const Saidas& saidas, const Opcoes& op, uint64_t& chave) const {
+        Fonte fonte;
+        if (!fonte.abrir(arquivo)) return false;
+        ostringstream config;
+        config << VERSAO_COMPILADOR << '\n' << op.gravaTabela << op.gravaCodigo << op.geraAssembly << op.nivelOtimizacao
+               << op.diagnosticosJson << op.gravaTokens << op.limiteErros.semRepetidos << ' ' << op.limiteErros.maximo
+               << ' ' << op.maxProfundidade << '\n'
+               << saidas.tabela << '\n' << saidas.intermediario << '\n' << saidas.assembly << '\n' << saidas.diagnosticos << '\n' << saidas.tokens
+               << '\n' << op.gravaUnidade << saidas.unidade << '\n'
+               << (op.diagnosticosJson || op.gravaUnidade ? arquivo : ""); // o JSON e a unidade guardam o caminho
+        string c = config.str();
+        string_view texto = fonte.texto();
+        chave = hash64(texto.data(), texto.size(), hash64(c.data(), c.size()));
+        return true;
+    }
+
+    // Num acerto grava os arquivos guardados, escreve o relatorio em 'rel' e marca o uso da entrada
+    bool busca(uint64_t chave, const Saidas& saidas, ostream& rel, bool& semErros, int& codigo) {
+        string conteudo;
+        string arquivo = caminho(chave);
+        if (!leArquivo(arquivo, conteudo) || conteudo.size() < 32) {
+            faltas++;
+            return false;
+        }
+        string_view dados(conteudo);
+        uint32_t magico, presentes;
+        uint64_t chaveGuardada, verificacao;
+        memcpy(&magico, dados.data(), 4);
+        memcpy(&chaveGuardada, dados.data() + 4, 8);
+        memcpy(&verificacao, dados.data() + dados.size() - 8, 8);
+        dados = dados.substr(12, dados.size() - 20);
+        if (magico != MAGICO || chaveGuardada != chave || hash64(dados.data(), dados.size()) != verificacao) {
+            error_code ec;
+            filesystem::remove(arquivo, ec); // corrompida ou de outra chave
+            faltas++;
+            return false;
+        }
+
+        int32_t cod;
+        memcpy(&cod, dados.data(), 4);
+        memcpy(&presentes, dados.data() + 4, 4);
+        semErros = dados[8] != 0;
+        dados.remove_prefix(9);
+        string relatorio, artefato;
+        leTexto(dados, relatorio);
+        const string* destinos[NUM_ARTEFATOS] = {&saidas.tabela, &saidas.intermediario, &saidas.assembly, &saidas.diagnosticos, &saidas.tokens,
+                                                 &saidas.unidade};
+        for (int k = 0; k < NUM_ARTEFATOS; k++) {
+            if (!(presentes >> k & 1)) continue;
+            if (!leTexto(dados, artefato) || !gravaArquivo(*destinos[k], artefato)) {
+                faltas++;
+                return false;
+            }
+        }
+        error_code ec;
+        filesystem::last_write_time(arquivo, filesystem::file_time_type::clock::now(), ec);
+        rel << relatorio;
+        codigo = cod;
+        acertos++;
+        return true;
+    }
+
+    // Guarda o resultado de uma compilacao; os arquivos gerados sao lidos de volta do disco
+    void guarda(uint64_t chave, const Saidas& saidas, const Opcoes& op, const string& relatorio, bool semErros, int codigo) {
+        bool gerou[NUM_ARTEFATOS] = {op.gravaTabela, semErros && op.gravaCodigo, semErros && op.geraAssembly, op.diagnosticosJson, op.gravaTokens,
+                                     semErros && op.gravaUnidade};
+        const string* origens[NUM_ARTEFATOS] = {&saidas.tabela, &saidas.intermediario, &saidas.assembly, &saidas.diagnosticos, &saidas.tokens,
+                                                &saidas.unidade};
+        string dados(12, '\0');
+        int32_t cod = codigo;
+        uint32_t presentes = 0;
+        for (int k = 0; k < NUM_ARTEFATOS; k++) presentes |= (uint32_t)gerou[k] << k;
+        dados.append((const char*)&cod, 4);
+        dados.append((const char*)&presentes, 4);
+        dados += (char)semErros;
+        gravaTexto(dados, relatorio);
+        string artefato;
+        for (int k = 0; k < NUM_ARTEFATOS; k++) {
+            if (!gerou[k]) continue;
+            if (!leArquivo(*origens[k], artefato)) return;
+            gravaTexto(dados, artefato);
+            if (dados.size() > limite) return; // nao cabe no cache
+        }
+        uint64_t verificacao = hash64(dados.data() + 12, dados.size() - 12);
+        dados.append((const char*)&verificacao, 8);
+        memcpy(&dados[0], &MAGICO, 4);
+        memcpy(&dados[4], &chave, 8);
+
+        // Escreve ao lado e renomeia: quem le nunca ve uma entrada pela metade
+        string final = caminho(chave);
+        char sufixo[48];
+        snprintf(sufixo, sizeof sufixo, ".%016llx.%llu.tmp", (unsigned long long)instancia, (unsigned long long)temporarios++);
+        string temp = final + sufixo;
+        error_code ec;
+        if (!gravaArquivo(temp, dados)) {
+            filesystem::remove(temp, ec);
+            return;
+        }
+        filesystem::rename(temp, final, ec);
+        if (ec) filesystem::remove(temp, ec);
+        else gravadas++;
+    }
+
+    // Remove as entradas usadas ha mais tempo ate o total ficar em 90% do limite
+    void limpa() {
+        struct Entrada {
+            filesystem::file_time_type uso;
+            uint64_t tamanho;
+            filesystem::path caminho;
+        };
+        vector<Entrada> entradas;
+        uint64_t total = 0;
+        error_code ec;
+        for (filesystem::directory_iterator it(dir, ec), fim; !ec && it != fim; it.increment(ec)) {
+            if (it->path().extension() != ".cache") continue;
+            error_code ec2;
+            uint64_t tam = it->file_size(ec2);
+            auto uso = it->last_write_time(ec2);
+            if (ec2) continue;
+            entradas.push_back({uso, tam, it->path()});
+            total += tam;
+        }
+        if (total <= limite) return;
+        sort(entradas.begin(), entradas.end(), [](const Entrada& a, const Entrada& b) { return a.uso < b.uso; });
+        for (const Entrada& e : entradas) {
+            if (total <= limite / 10 * 9) break;
+            if (filesystem::remove(e.caminho, ec)) removidas++;
+            total -= e.tamanho;
+        }
+    }
+
+    void relata(ostream& rel) const {
+        rel << "- Cache: " << acertos << " acertos, " << faltas << " faltas, " << gravadas << " entradas gravadas, "
+            << removidas << " removidas -\n";
+    }
+};
 
-    static vector<string> simbolosCompostos = { ":=", "<=", ">=", "<>", "++", "--" };
-    for (auto& sc : simbolosCompostos) {
-        if (sc == lex) return "simbolo_composto";
+// Compila pelo cache, se houver: num acerto nao roda nenhuma fase do compilador.
+// Execucao, estatisticas e rastro sempre compilam de novo
+int compilaComCache(const string& arquivo, const Saidas& saidas, const Opcoes& op, CacheCompilacao* cache, ostream& rel, bool& semErros) {
+    uint64_t chave;
+    if (!cache || op.executar || op.mostraEstatisticas || op.rastro || !cache->chave(arquivo, saidas, op, chave)) {
+        return compilaArquivo(arquivo, saidas, op, rel, semErros);
     }
+    int codigo;
+    if (cache->busca(chave, saidas, rel, semErros, codigo)) return codigo;
+    ostringstream r;
+    codigo = compilaArquivo(arquivo, saidas, op, r, semErros);
+    string relatorio = r.str();
+    rel << relatorio;
+    if (codigo == 0) cache->guarda(chave, saidas, op, relatorio, semErros, codigo);
+    return codigo;
+}
 
-    static vector<string> simbolosSimples = { "+", "-", "*", "/", "=", "^", "<", ">", ";", ".", ":", ",", "(", ")", "{", "}", "[", "]" };
-    for (auto& ss : simbolosSimples) {
-        if (ss == lex) return "simbolo";
+// Refaz a tabela de simbolos a partir de um arquivo de tokens (--ler-tokens),
+// lendo os tokens direto do arquivo mapeado
+int leTokens(const string& arquivo, const string& saidaTabela, ostream& rel) {
+    LeitorTokens leitor;
+    string erro = leitor.abrir(arquivo);
+    if (!erro.empty()) {
+        rel << "Erro: " << erro << "\n";
+        return 1;
     }
-
-    return "desconhecido";
+    EscritorTabela tabela;
+    if (!tabela.abre(saidaTabela)) {
+        cerr << "Erro: Nao abriu arquivo de saida '" << saidaTabela << "'\n";
+        return 1;
+    }
+    tabela.cabecalho();
+    const TokenBin* tokens = leitor.tokens();
+    for (uint64_t k = 0; k < leitor.numTokens(); k++) {
+        const TokenBin& t = tokens[k];
+        tabela.linha(leitor.texto(t.inicio, t.tamanho), t.tipo <= TK_EOF ? (TipoToken)t.tipo : TK_ERRO_LEXICO, t.linha);
+    }
+    if (!tabela.fecha()) {
+        cerr << "Erro: Falha ao gravar '" << saidaTabela << "'\n";
+        return 1;
+    }
+    rel << leitor.numTokens() << " tokens e " << leitor.numNomes() << " nomes lidos de '" << arquivo
+        << "'. Tabela de simbolos salva em '" << saidaTabela << "'.\n";
+    return 0;
 }
 
-pair<vector<Simbolo>, vector<string>> analisarLexico(const string& arquivo) { // separar em tokens
-    ifstream arq(arquivo);
-    vector<Simbolo> tabela;
-    vector<string> erros;
+// Mostra o que uma unidade compilada (--ler-unidade) guarda, lido direto do
+// arquivo mapeado. Falha se ela estiver corrompida ou se o fonte mudou depois
+int leUnidade(const string& arquivo, ostream& rel) {
+    LeitorUnidade unidade;
+    string erro = unidade.abrir(arquivo);
+    if (erro.empty() && !unidade.confere()) erro = "Unidade corrompida";
+    if (!erro.empty()) {
+        rel << "Erro: " << erro << "\n";
+        return 1;
+    }
+    string caminho(unidade.caminhoFonte());
+    Fonte fonte;
+    if (fonte.abrir(caminho) && !unidade.atual(fonte.texto())) {
+        rel << "Erro: Unidade desatualizada; o fonte '" << caminho << "' mudou depois dela\n";
+        return 1;
+    }
+    rel << "Unidade de '" << caminho << "': " << unidade.numLinhas() << " linhas, " << unidade.numNos() << " nos, "
+        << unidade.numDecls() << " declaracoes.\n";
+    const DeclBin* decls = unidade.decls();
+    for (uint64_t k = 0; k < unidade.numDecls(); k++) {
+        Tipo tipo = decls[k].tipo < NUM_TIPOS ? (Tipo)decls[k].tipo : T_DESCONHECIDO;
+        rel << "  " << unidade.nome(decls[k].id) << ": " << nomeTipo[tipo] << "\n";
+    }
+    return 0;
+}
 
-    if (!arq.is_open()) {
-        erros.push_back("Erro: Nao abriu arquivo '" + arquivo + "'\n");
-        return {tabela, erros};
+// Modo de edicao: abre o arquivo e le de 'cmds' edicoes no formato
+//   editar <linha> <removidas> <novas>
+// seguido das <novas> linhas de texto (a primeira linha e 1). Depois de cada uma
+// reanalisa so o que mudou e imprime os erros como na compilacao
+int sessaoIncremental(const string& arquivo, istream& cmds, ostream& rel) {
+    Documento doc;
+    if (!doc.abrir(arquivo)) {
+        rel << "Erro: Nao abriu arquivo '" << arquivo << "'\n";
+        return 1;
     }
+    bool ok = relataErros(rel, doc.errosLexicos(), doc.errosSintaticos(), doc.errosSemanticos());
 
-    string linha;
-    int numLinha = 0;
-    bool comentAberto = false;
-    
-    regex separador(R"((<=|>=|:=|<>|\+\+|--|\".*?\"|[a-zA-Z_][a-zA-Z0-9_]*|\d*\.\d+\.\d*|\d+\.\d+|[+*/=<>;:.,()\[\]{}^$])|\s+)");
-    regex coment1(R"(\{.*?\}|\(\*.*?\*\))");
-
-    while (getline(arq, linha)) {
-        numLinha++;
-
-        if (comentAberto) {
-            size_t fimCom = linha.find("*)");
-            if (fimCom != string::npos) { // string::npos = não encontrado
-                comentAberto = false;
-                linha = linha.substr(fimCom + 2); // pula 2 caracteres
-            } else {
-                continue;
-            }
+    string cmd;
+    while (cmds >> cmd && cmd != "fim") {
+        size_t linha = 0, removidas = 0, quantas = 0;
+        if (cmd != "editar" || !(cmds >> linha >> removidas >> quantas)) {
+            cerr << "Erro: Comando de edicao invalido '" << cmd << "'\n";
+            return 1;
         }
+        cmds.ignore(numeric_limits<streamsize>::max(), '\n');
+        vector<string> novas(quantas);
+        for (string& l : novas) getline(cmds, l);
+
+        auto inicio = chrono::steady_clock::now();
+        doc.edita(linha > 0 ? linha - 1 : 0, removidas, novas);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - inicio).count();
+        const Documento::Estatisticas& e = doc.getEstatisticas();
+        rel << "\n- Edicao: " << e.linhasRelidas << " linhas relidas, " << e.tokensReanalisados << " tokens reanalisados"
+            << (e.completa ? " (programa inteiro)" : "") << ", " << fixed << setprecision(3) << ms << " ms -\n";
+        ok = relataErros(rel, doc.errosLexicos(), doc.errosSintaticos(), doc.errosSemanticos());
+    }
+    return ok ? 0 : 1;
+}
 
-        string linhaSemComentarios = regex_replace(linha, coment1, " ");
+// Servidor de verificacao (--servidor): le pedidos JSON-RPC 2.0 da entrada, um por
+// linha ou com cabecalho Content-Length (como no LSP), e responde na saida no mesmo
+// formato. Metodos:
+//   verificarArquivo {arquivo, maxErros?}       analisa o arquivo do disco
+//   verificarTexto   {documento, texto, maxErros?}  analisa um texto da memoria
+//   tokens           {arquivo | documento, texto?}  tokens do documento
+//   fechar           {documento | arquivo}      descarta o estado do documento
+//   encerrar                                     termina depois dos pedidos pendentes
+// Cada documento fica aberto num Documento: um novo texto so rele as linhas que
+// mudaram, e enquanto o arquivo ou o texto nao mudam a ultima resposta e reusada.
+// Documentos diferentes rodam em paralelo; os pedidos do mesmo documento rodam um
+// de cada vez e na ordem em que chegaram (cada edicao depende da anterior)
+class Servidor {
+    enum ErroRpc { RPC_JSON = -32700, RPC_PEDIDO = -32600, RPC_METODO = -32601, RPC_PARAMETROS = -32602, RPC_ARQUIVO = -32000 };
 
-        size_t poscoment1 = linhaSemComentarios.find('{');
-        if (poscoment1 != string::npos) {
-            if (linhaSemComentarios.find('}', poscoment1) == string::npos) {
-                erros.push_back("Erro lexico linha " + to_string(numLinha) + ": Comentario '{' nao fechado\n");
-                linhaSemComentarios = linhaSemComentarios.substr(0, poscoment1);
-            }
-        }
+    struct Estado {
+        mutex m;
+        Documento doc;
+        bool carregado = false;
+        // versao do arquivo analisado; sem arquivo (texto enviado) nao vale
+        bool temVersao = false;
+        filesystem::file_time_type modificado;
+        uintmax_t tamanho = 0;
+        string resultado; // ultima resposta de verificacao, valida ate o texto mudar
+        size_t maximoResultado = 0;
+    };
 
-        size_t poscomment2 = linhaSemComentarios.find("(*");
-        if (poscomment2 != string::npos) {
-            if (linhaSemComentarios.find("*)", poscomment2 + 2) == string::npos) {
-                erros.push_back("Erro lexico linha " + to_string(numLinha) + ": Comentario '(*' nao fechado\n");
-                comentAberto = true;
-                linhaSemComentarios = linhaSemComentarios.substr(0, poscomment2);
-            }
-        }
+    struct Mensagem {
+        string texto;
+        bool cabecalho;   // veio com Content-Length
+        string documento; // chave do documento; vazia se o pedido nao tem um
+    };
 
-        sregex_token_iterator it(linhaSemComentarios.begin(), linhaSemComentarios.end(), separador, {0}); 
-        sregex_token_iterator end;
+    istream& entrada;
+    ostream& saida;
+    mutex mSaida;
 
-        for (; it != end; ++it) {
-            string lex = it->str();
-            if (lex.empty() || all_of(lex.begin(), lex.end(), ::isspace)) continue;
-            
-            string t = tipoLex(lex);
+    mutex mDocs;
+    unordered_map<string, shared_ptr<Estado>> docs;
 
-            if (t == "desconhecido" || t == "numero_invalido") {
-                string msg = "Erro lexico linha " + to_string(numLinha) + ": ";
-                if (t == "numero_invalido") msg += "Numero invalido '" + lex + "'\n";
-                else if (lex.length() == 1 && !isalnum(lex[0])) msg += "Caractere '" + lex + "' nao identificado\n";
-                else msg += "Sequencia '" + lex + "' nao identificada\n";
-                erros.push_back(msg);
-                tabela.push_back({lex, "erro_lexico", numLinha}); 
-            } else {
-                tabela.push_back({lex, t, numLinha});
+    // 'fila' tem no maximo um pedido de cada documento; os seguintes esperam em
+    // 'emEspera' ate o anterior terminar. Documento com pedido na fila ou rodando
+    // tem entrada em 'emEspera', mesmo que vazia
+    mutex mFila;
+    condition_variable temPedido;
+    deque<Mensagem> fila;
+    unordered_map<string, deque<Mensagem>> emEspera;
+    bool fechada = false;
+
+    // Com mFila travado
+    void enfileira(Mensagem&& msg) {
+        if (!msg.documento.empty()) {
+            auto [it, novo] = emEspera.try_emplace(msg.documento);
+            if (!novo) {
+                it->second.push_back(move(msg));
+                return;
             }
         }
+        fila.push_back(move(msg));
+        temPedido.notify_one();
     }
-    
-    if (comentAberto) {
-        erros.push_back("Erro lexico linha " + to_string(numLinha) + ": Comentario '(*' nao fechado no fim do arquivo\n");
-    }
-
-    arq.close();
-    return {tabela, erros};
-}
 
+    // Pedido do documento terminou: libera o proximo dele, se houver
+    void terminou(const string& documento) {
+        if (documento.empty()) return;
+        lock_guard<mutex> trava(mFila);
+        auto it = emEspera.find(documento);
+        if (it->second.empty()) {
+            emEspera.erase(it);
+            return;
+        }
+        fila.push_back(move(it->second.front()));
+        it->second.pop_front();
+        temPedido.notify_one();
+    }
 
-class Sintatico {
-    const vector<Simbolo>& tokens;
-    vector<string> errosSintaticos;
-    vector<string> errosSemanticos;
-    size_t posToken;
-    unordered_map<string, string> tabelaSimbolos;
+    void envia(const string& corpo, bool cabecalho) {
+        lock_guard<mutex> trava(mSaida);
+        if (cabecalho) saida << "Content-Length: " << corpo.size() << "\r\n\r\n" << corpo;
+        else saida << corpo << '\n';
+        saida.flush();
+    }
 
-    Simbolo atual() {
-        if (posToken < tokens.size()) return tokens[posToken];
-        return {"EOF", "EOF", tokens.empty() ? 0 : tokens.back().linha + 1};
+    static string resposta(const string& id, const string& resultado) {
+        return "{\"jsonrpc\": \"2.0\", \"id\": " + id + ", \"result\": " + resultado + "}";
     }
 
-    void avanca() {
-        if (posToken < tokens.size()) posToken++;
+    static string erro(const string& id, int codigo, string_view mensagem) {
+        return "{\"jsonrpc\": \"2.0\", \"id\": " + id + ", \"error\": {\"code\": " + to_string(codigo) +
+               ", \"message\": " + textoJson(mensagem) + "}}";
     }
 
-    void sincroniza() {
-        avanca();
-        while (atual().tipo != "EOF") {
-            if (atual().lexema == ";") {
-                return;
-            }
-            string lex = atual().lexema;
-            if (lex == "if" || lex == "while" || lex == "read" ||
-                lex == "write" || lex == "begin" || lex == "var" ||
-                lex == "end" || atual().tipo == "Identificador") {
-                return;
-            }
-            avanca();
-        }
+    shared_ptr<Estado> estado(const string& chave) {
+        lock_guard<mutex> trava(mDocs);
+        shared_ptr<Estado>& e = docs[chave];
+        if (!e) e = make_shared<Estado>();
+        return e;
     }
 
-    bool casa(const string& esperado, bool isLexema = true) {
-        if (atual().tipo == "EOF") {
-            errosSintaticos.push_back("Erro sintatico linha " + to_string(tokens.empty() ? 1 : tokens.back().linha + 1) + ": Fim de arquivo inesperado. Esperava '" + esperado + "'.\n");
-            return false;
-        }
-        string valorAtual = isLexema ? atual().lexema : atual().tipo;
-        if (valorAtual == esperado) {
-            avanca();
+    // Poe no documento o texto atual (do arquivo ou do pedido); devolve false se o
+    // arquivo nao abriu. Com o estado travado
+    static bool atualiza(Estado& e, const string& arquivo, const Json* texto) {
+        auto poe = [&](string_view t) {
+            bool mudou = !e.carregado || e.doc.atualiza(t);
+            if (!e.carregado) e.doc.carrega(t);
+            e.carregado = true;
+            if (mudou) e.resultado.clear();
+        };
+        if (texto) {
+            e.temVersao = false;
+            poe(texto->texto);
             return true;
-        } else {
-            string tipoEsperadoStr = isLexema ? "lexema" : "tipo";
-            string msg = "Erro sintatico linha " + to_string(atual().linha) + ": ";
-            msg += "Esperava " + tipoEsperadoStr + " '" + esperado + "', mas encontrou '" + atual().lexema + "'.\n";
-            errosSintaticos.push_back(msg);
-            return false;
         }
+        error_code ec1, ec2;
+        auto modificado = filesystem::last_write_time(arquivo, ec1);
+        uintmax_t tamanho = filesystem::file_size(arquivo, ec2);
+        if (!ec1 && !ec2 && e.carregado && e.temVersao && modificado == e.modificado && tamanho == e.tamanho) return true;
+        Fonte fonte;
+        if (!fonte.abrir(arquivo)) return false;
+        poe(fonte.texto());
+        e.temVersao = !ec1 && !ec2;
+        e.modificado = modificado;
+        e.tamanho = tamanho;
+        return true;
     }
 
-    bool estaDeclarada(const string& id, int linha) {
-        if (tabelaSimbolos.find(id) == tabelaSimbolos.end()) {
-            errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Variavel '" + id + "' nao declarada.\n");
-            return false;
+    string verifica(Estado& e, const string& nome, size_t maximo) {
+        if (!e.resultado.empty() && e.maximoResultado == maximo) return e.resultado;
+        const Documento::Estatisticas& est = e.doc.getEstatisticas();
+        ostringstream r;
+        r << "{\"documento\": " << textoJson(nome) << ", \"linhas\": " << e.doc.numLinhas() << ", \"tokens\": " << e.doc.numTokens()
+          << ", \"linhasRelidas\": " << est.linhasRelidas << ", \"tokensReanalisados\": " << est.tokensReanalisados << ", ";
+        escreveDiagnosticosJson(r, e.doc.errosLexicos(), e.doc.errosSintaticos(), e.doc.errosSemanticos(), maximo, true);
+        r << "}";
+        e.resultado = r.str();
+        e.maximoResultado = maximo;
+        return e.resultado;
+    }
+
+    static string tokens(const Estado& e) {
+        Fonte fonte;
+        vector<Simbolo> lista = e.doc.tokens(fonte);
+        string r = "{\"tokens\": [";
+        for (size_t k = 0; k < lista.size(); k++) {
+            const Simbolo& t = lista[k];
+            r += k ? ", {\"lexema\": " : "{\"lexema\": ";
+            r += textoJson(fonte.lexema(t));
+            r += ", \"tipo\": ";
+            r += textoJson(nomeTipoToken[t.tipo]);
+            r += ", \"linha\": " + to_string(t.linha) + ", \"coluna\": " + to_string(t.coluna) + "}";
         }
-        return true;
+        return r + "]}";
     }
 
-    void declararVariavel(const string& id, const string& tipo, int linha) {
-        if (tabelaSimbolos.find(id) != tabelaSimbolos.end()) {
-            errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Redeclaracao da variavel '" + id + "'.\n");
-        } else {
-            tabelaSimbolos[id] = tipo;
+    // Atende um pedido; devolve a resposta, ou "" para notificacoes (sem id)
+    string atende(const string& texto) {
+        Json pedido;
+        if (!LeitorJson().le(texto, pedido)) return erro("null", RPC_JSON, "JSON invalido");
+        const Json* id = pedido.campo("id");
+        const Json* metodo = pedido.campo("method");
+        string idTexto = id ? id->id() : "null";
+        if (!metodo || metodo->tipo != Json::TEXTO || (id && id->tipo != Json::NUMERO && id->tipo != Json::TEXTO && id->tipo != Json::NULO)) {
+            return erro(idTexto, RPC_PEDIDO, "Pedido invalido");
         }
+        string r = executa(metodo->texto, pedido.campo("params"), idTexto);
+        return id ? r : "";
     }
 
-    string tipoExpressao() {
-        size_t posInicial = posToken;
-        string tipo = tipoExpressaoSimples();
-        while (atual().lexema == "=" || atual().lexema == "<>" || atual().lexema == "<" ||
-               atual().lexema == ">" || atual().lexema == "<=" || atual().lexema == ">=") {
-            string op = atual().lexema;
-            int linha = atual().linha;
-            avanca();
-            string tipo2 = tipoExpressaoSimples();
-            if (tipo != tipo2) {
+    string executa(const string& metodo, const Json* params, const string& id) {
+        static const Json vazio;
+        if (!params) params = &vazio;
+        auto texto = [&](const char* chave) -> const Json* {
+            const Json* v = params->campo(chave);
+            return v && v->tipo == Json::TEXTO ? v : nullptr;
+        };
+        const Json* arquivo = texto("arquivo");
+        const Json* documento = texto("documento");
+        const Json* conteudo = texto("texto");
+        size_t maximo = SIZE_MAX;
+        if (const Json* m = params->campo("maxErros"); m && m->tipo == Json::NUMERO) maximo = strtoull(m->texto.c_str(), nullptr, 10);
 
-                errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Tipos incompativeis na operacao relacional '" + op + "' (" + tipo + " e " + tipo2 + ").\n");
+        if (metodo == "verificarArquivo" || metodo == "verificarTexto" || metodo == "tokens") {
+            if (metodo == "verificarArquivo" ? !arquivo : metodo == "verificarTexto" ? !documento || !conteudo
+                                                                                      : !arquivo && !documento) {
+                return erro(id, RPC_PARAMETROS, "Parametros invalidos para '" + metodo + "'");
             }
-            tipo = "boolean";
+            const string& nome = documento ? documento->texto : arquivo->texto;
+            shared_ptr<Estado> e = estado(nome);
+            lock_guard<mutex> trava(e->m);
+            // 'tokens' so com o documento usa o texto que ele ja tem
+            bool doDisco = metodo == "verificarArquivo" || (!conteudo && (arquivo || !e->carregado));
+            if ((doDisco || conteudo) && !atualiza(*e, nome, doDisco ? nullptr : conteudo)) {
+                return erro(id, RPC_ARQUIVO, "Nao abriu arquivo '" + nome + "'");
+            }
+            return resposta(id, metodo == "tokens" ? tokens(*e) : verifica(*e, nome, maximo));
+        }
+        if (metodo == "fechar") {
+            if (!arquivo && !documento) return erro(id, RPC_PARAMETROS, "Parametros invalidos para 'fechar'");
+            lock_guard<mutex> trava(mDocs);
+            bool havia = docs.erase(documento ? documento->texto : arquivo->texto) > 0;
+            return resposta(id, havia ? "true" : "false");
         }
-        posToken = posInicial;
-        return tipo;
+        return erro(id, RPC_METODO, "Metodo desconhecido '" + metodo + "'");
     }
 
-    string tipoExpressaoSimples() {
-        string tipo = tipoTermo();
-        while (atual().lexema == "+" || atual().lexema == "-" || atual().lexema == "or") {
-            string op = atual().lexema;
-            int linha = atual().linha;
-            avanca();
-            string tipo2 = tipoTermo();
-            if (op == "or") {
-                if (tipo != "boolean" || tipo2 != "boolean") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Operador 'or' requer operandos booleanos, encontrou " + tipo + " e " + tipo2 + ".\n");
-                }
-                tipo = "boolean";
-            } else {
-                if ((tipo == "integer" && tipo2 == "integer") || (tipo == "double" && tipo2 == "double") ||
-                    (tipo == "integer" && tipo2 == "double") || (tipo == "double" && tipo2 == "integer")) {
-                    tipo = (tipo == "double" || tipo2 == "double") ? "double" : "integer";
-                } else {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Tipos incompativeis na operacao '" + op + "' (" + tipo + " e " + tipo2 + ").\n");
-                }
+    bool leMensagem(Mensagem& msg) {
+        string linha;
+        while (getline(entrada, linha)) {
+            if (!linha.empty() && linha.back() == '\r') linha.pop_back();
+            if (linha.empty()) continue;
+            if (linha.compare(0, 15, "Content-Length:") != 0) {
+                msg = {move(linha), false, {}};
+                return true;
             }
+            size_t tam = strtoull(linha.c_str() + 15, nullptr, 10);
+            while (getline(entrada, linha) && linha != "\r" && !linha.empty()) {} // outros cabecalhos
+            msg = {string(tam, '\0'), true, {}};
+            return (bool)entrada.read(&msg.texto[0], (streamsize)tam);
         }
-        return tipo;
+        return false;
     }
 
-    string tipoTermo() {
-        string tipo = tipoFator();
-        while (atual().lexema == "*" || atual().lexema == "/" || atual().lexema == "and" ||
-               atual().lexema == "div" || atual().lexema == "mod") {
-            string op = atual().lexema;
-            int linha = atual().linha;
-            avanca();
-            string tipo2 = tipoFator();
-            if (op == "and") {
-                if (tipo != "boolean" || tipo2 != "boolean") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Operador 'and' requer operandos booleanos, encontrou " + tipo + " e " + tipo2 + ".\n");
-                }
-                tipo = "boolean";
-            } else if (op == "div" || op == "mod") {
-                if (tipo != "integer" || tipo2 != "integer") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Operador '" + op + "' requer operandos inteiros, encontrou " + tipo + " e " + tipo2 + ".\n");
-                }
-                tipo = "integer";
-            } else {
-                if ((tipo == "integer" && tipo2 == "integer") || (tipo == "double" && tipo2 == "double") ||
-                    (tipo == "integer" && tipo2 == "double") || (tipo == "double" && tipo2 == "integer")) {
-                    tipo = (tipo == "double" || tipo2 == "double") ? "double" : "integer";
-                } else {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Tipos incompativeis na operacao '" + op + "' (" + tipo + " e " + tipo2 + ").\n");
+public:
+    Servidor(istream& e, ostream& s) : entrada(e), saida(s) {}
+
+    // Atende ate 'encerrar' ou o fim da entrada
+    int roda(unsigned numThreads) {
+        // Cada resposta ja sai descarregada sob mSaida; amarrada, a entrada descarregaria
+        // a saida da thread que le, fora da trava
+        entrada.tie(nullptr);
+        vector<thread> threads;
+        for (unsigned t = 0; t < max(numThreads, 1u); t++) {
+            threads.emplace_back([this] {
+                for (;;) {
+                    Mensagem msg;
+                    {
+                        unique_lock<mutex> trava(mFila);
+                        temPedido.wait(trava, [this] { return fechada || !fila.empty(); });
+                        if (fila.empty()) return;
+                        msg = move(fila.front());
+                        fila.pop_front();
+                    }
+                    string r = atende(msg.texto);
+                    if (!r.empty()) envia(r, msg.cabecalho);
+                    terminou(msg.documento);
                 }
-            }
+            });
         }
-        return tipo;
-    }
-
-    string tipoFator() {
-        string t = atual().tipo;
-        string lex = atual().lexema;
-        int linha = atual().linha;
 
-        if (t == "Identificador") {
-            if (estaDeclarada(lex, linha)) {
-                return tabelaSimbolos[lex];
+        // 'encerrar' responde so depois que os pedidos anteriores terminaram
+        Mensagem msg;
+        string idEncerrar;
+        bool cabecalhoEncerrar = false;
+        while (leMensagem(msg)) {
+            Json pedido;
+            const Json* metodo = nullptr;
+            if (LeitorJson().le(msg.texto, pedido) && (metodo = pedido.campo("method")) && metodo->tipo == Json::TEXTO &&
+                metodo->texto == "encerrar") {
+                const Json* id = pedido.campo("id");
+                idEncerrar = id ? id->id() : "";
+                cabecalhoEncerrar = msg.cabecalho;
+                break;
             }
-            return "desconhecido";
-        } else if (t == "Numero inteiro") {
-            return "integer";
-        } else if (t == "Numero real") {
-            return "double";
-        } else if (t == "String literal") {
-            return "string";
-        } else if (lex == "true" || lex == "false") {
-            return "boolean";
-        } else if (lex == "(") {
-            avanca();
-            string tipo = tipoExpressao();
-            casa(")");
-            return tipo;
-        } else if (lex == "not") {
-            avanca();
-            string tipo = tipoFator();
-            if (tipo != "boolean") {
-                errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Operador 'not' requer operando booleano, encontrou " + tipo + ".\n");
+            // mesma chave que executa usa para o Estado
+            if (const Json* params = metodo ? pedido.campo("params") : nullptr) {
+                const Json* documento = params->campo("documento");
+                const Json* arquivo = params->campo("arquivo");
+                if (documento && documento->tipo == Json::TEXTO) msg.documento = documento->texto;
+                else if (arquivo && arquivo->tipo == Json::TEXTO) msg.documento = arquivo->texto;
             }
-            return "boolean";
-        } else if (t == "erro_lexico") {
-            return "desconhecido";
-        } else {
-            errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Token inesperado '" + lex + "' na expressao.\n");
-            return "desconhecido";
+            lock_guard<mutex> trava(mFila);
+            enfileira(move(msg));
         }
+        {
+            lock_guard<mutex> trava(mFila);
+            fechada = true;
+        }
+        temPedido.notify_all();
+        for (thread& t : threads) t.join();
+        if (!idEncerrar.empty()) envia(resposta(idEncerrar, "null"), cabecalhoEncerrar);
+        return 0;
+    }
+};
+
+// Compila varios arquivos em paralelo. Cada um grava as proprias saidas ao lado
+// da entrada (<arquivo>.tabela.txt, ...) e os relatorios saem em 'rel' na ordem
+// dos arquivos, a medida que ficam prontos
+int compilaLote(const vector<string>& arquivos, const Opcoes& op, unsigned numThreads, CacheCompilacao* cache, ostream& rel) {
+    size_t n = arquivos.size();
+    vector<string> relatorios(n);
+    vector<uint8_t> semErros(n, 0), prontos(n, 0);
+    vector<int> codigos(n, 0);
+    mutex m;
+    condition_variable avisa;
+
+    // Maiores primeiro, para nenhum arquivo grande sobrar para o fim
+    vector<size_t> ordem(n);
+    vector<uintmax_t> tamanhos(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        ordem[i] = i;
+        error_code ec;
+        tamanhos[i] = filesystem::file_size(arquivos[i], ec);
+        if (ec) tamanhos[i] = 0;
     }
+    stable_sort(ordem.begin(), ordem.end(), [&](size_t a, size_t b) { return tamanhos[a] > tamanhos[b]; });
 
-    void prog() {
-        if (!casa("Program")) {
-            sincroniza();
-        }
-        if (!casa("Identificador", false)) {
-            sincroniza();
-        }
-        if (!casa(";")) {
-            sincroniza();
+    PoolTrabalho pool(numThreads);
+    for (size_t i : ordem) {
+        pool.adiciona([&, i] {
+            Saidas saidas;
+            saidas.tabela = arquivos[i] + ".tabela.txt";
+            saidas.intermediario = arquivos[i] + ".intermediario.txt";
+            saidas.assembly = arquivos[i] + ".s";
+            saidas.diagnosticos = arquivos[i] + ".diagnosticos.json";
+            saidas.tokens = arquivos[i] + ".tokens.bin";
+            saidas.unidade = arquivos[i] + ".unidade";
+            ostringstream r;
+            bool ok = false;
+            int codigo = compilaComCache(arquivos[i], saidas, op, cache, r, ok);
+            lock_guard<mutex> trava(m);
+            relatorios[i] = r.str();
+            semErros[i] = ok;
+            codigos[i] = codigo;
+            prontos[i] = 1;
+            avisa.notify_one();
+        });
+    }
+    pool.inicia();
+
+    size_t comErros = 0;
+    int codigoFinal = 0;
+    for (size_t i = 0; i < n; i++) {
+        string texto;
+        {
+            unique_lock<mutex> trava(m);
+            avisa.wait(trava, [&] { return prontos[i] != 0; });
+            texto.swap(relatorios[i]);
         }
-        bloco();
-        casa(".");
-        if (atual().tipo != "EOF") {
-            errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Tokens adicionais depois do fim do programa.\n");
+        rel << "=== " << arquivos[i] << " ===\n" << texto << "\n";
+        if (!semErros[i]) {
+            comErros++;
+            codigoFinal = 1;
         }
+        if (codigos[i]) codigoFinal = 1;
     }
+    pool.espera();
+    rel << "- " << n << " arquivos compilados, " << comErros << " com erros -\n";
+    return codigoFinal;
+}
 
-    void bloco() {
-        if (atual().lexema == "var") {
-            declVar();
-        }
-        if (!casa("begin")) {
-            sincroniza();
+// "64", "10K", "5M", "1G" em bytes
+uint64_t leTamanho(const string& s) {
+    char* fim;
+    uint64_t n = strtoull(s.c_str(), &fim, 10);
+    switch (toupper((unsigned char)*fim)) {
+        case 'K': return n << 10;
+        case 'M': return n << 20;
+        case 'G': return n << 30;
+        default: return n;
+    }
+}
+
+struct ConfigGerador {
+    uint64_t tamanho = 1 << 20;  // bytes aproximados do programa
+    uint64_t semente = 1;
+    int profundidade = 3;        // aninhamento maximo de comandos e de expressoes
+    int identificadores = 32;    // variaveis declaradas
+    double comentarios = 0.05;   // chance de um comentario antes de cada comando
+    double strings = 0.1;        // chance de uma string literal em cada argumento de 'write'
+    double erros = 0;            // chance de um erro injetado em cada comando do corpo
+};
+
+// Gera programas do subconjunto aceito, do tamanho pedido. Sem erros injetados o
+// programa passa nas tres analises; a mesma semente gera sempre o mesmo texto
+class GeradorProgramas {
+    const ConfigGerador& cfg;
+    uint64_t estado;
+    string buf;
+    ostream& saida;
+    uint64_t escritos = 0;
+    vector<string> vars[3]; // integer, double, boolean
+
+    enum TipoGerado { G_INT, G_REAL, G_BOOL };
+    static constexpr const char* OPS_INT[] = {" + ", " - ", " * ", " div ", " mod "};
+    static constexpr const char* OPS_REAL[] = {" + ", " - ", " * ", " / "};
+    static constexpr const char* OPS_REL[] = {" = ", " <> ", " < ", " > ", " <= ", " >= "};
+
+    uint64_t sorteia() { // splitmix64
+        uint64_t z = (estado += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    uint32_t ate(uint32_t n) { return (uint32_t)(sorteia() % n); }
+    bool chance(double p) { return (double)(sorteia() >> 11) * 0x1.0p-53 < p; }
+
+    void escreve(string_view s) {
+        buf += s;
+        if (buf.size() >= (1u << 20)) descarrega();
+    }
+    void descarrega() {
+        saida.write(buf.data(), (streamsize)buf.size());
+        escritos += buf.size();
+        buf.clear();
+    }
+    uint64_t tamanho() const { return escritos + buf.size(); }
+
+    void indenta(int nivel) { escreve(string(2 * nivel, ' ')); }
+
+    const string& var(TipoGerado t) { return vars[t][ate((uint32_t)vars[t].size())]; }
+
+    void expressao(TipoGerado t, int prof) {
+        bool folha = prof <= 0 || chance(0.4);
+        switch (t) {
+            case G_INT:
+                if (folha) {
+                    if (chance(0.5)) escreve(var(G_INT));
+                    else escreve(to_string(ate(1000)));
+                    return;
+                }
+                escreve("(");
+                expressao(G_INT, prof - 1);
+                escreve(OPS_INT[ate(5)]);
+                expressao(G_INT, prof - 1);
+                escreve(")");
+                return;
+            case G_REAL:
+                if (folha) {
+                    if (chance(0.5)) escreve(var(G_REAL));
+                    else escreve(to_string(ate(1000)) + "." + to_string(ate(100)));
+                    return;
+                }
+                escreve("(");
+                expressao(G_REAL, prof - 1);
+                escreve(OPS_REAL[ate(4)]);
+                expressao(chance(0.3) ? G_INT : G_REAL, prof - 1);
+                escreve(")");
+                return;
+            case G_BOOL:
+                if (folha) {
+                    if (chance(0.6)) escreve(var(G_BOOL));
+                    else escreve(chance(0.5) ? "true" : "false");
+                    return;
+                }
+                switch (ate(3)) {
+                    case 0: {
+                        TipoGerado lados = chance(0.7) ? G_INT : G_REAL;
+                        escreve("(");
+                        expressao(lados, prof - 1);
+                        escreve(OPS_REL[ate(6)]);
+                        expressao(lados, prof - 1);
+                        escreve(")");
+                        return;
+                    }
+                    case 1:
+                        escreve("(");
+                        expressao(G_BOOL, prof - 1);
+                        escreve(chance(0.5) ? " and " : " or ");
+                        expressao(G_BOOL, prof - 1);
+                        escreve(")");
+                        return;
+                    default:
+                        escreve("not ");
+                        expressao(G_BOOL, prof - 1);
+                        return;
+                }
         }
-        listaComandos();
-        casa("end");
     }
 
-    void declVar() {
-        casa("var");
-        while (atual().lexema != "begin" && atual().tipo != "EOF") {
-            if (atual().tipo != "Identificador") {
+    // Comentarios ficam numa linha so: '(*' aberto no fim da linha e erro lexico
+    void comentario(int nivel) {
+        indenta(nivel);
+        if (chance(0.5)) escreve("{ comentario de uma linha }\n");
+        else escreve("(* comentario " + to_string(ate(100000)) + " *)\n");
+    }
 
-                errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Esperava um identificador para iniciar a declaracao.\n");
-                sincroniza();
-                if (atual().lexema == "begin" || atual().tipo == "EOF") break;
-                continue;
+    // Um comando sem o ';' final; 'erro' troca uma parte dele por um erro
+    void comando(int nivel, int prof, bool erro) {
+        if (chance(cfg.comentarios)) comentario(nivel);
+        indenta(nivel);
+        uint32_t tipo = prof > 0 ? ate(8) : ate(4);
+        if (erro) {
+            switch (ate(4)) {
+                case 0: escreve("nd" + to_string(ate(100)) + " := 1"); return;  // nao declarada
+                case 1: escreve(var(G_INT) + " := true"); return;                 // tipos
+                case 2: escreve(var(G_INT) + " = 1"); return;                     // '=' no lugar de ':='
+                default: escreve(var(G_INT) + " := 1 $ 2"); return;               // caractere invalido
             }
-            vector<string> ids;
-            listaIds(ids);
-            if (!casa(":")) {
-                if (atual().lexema == "integer" || atual().lexema == "boolean" || atual().lexema == "double") {
-    
-                    errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Falta ':' antes do tipo '" + atual().lexema + "'.\n");
-                } else {
-                    sincroniza();
-                    if (atual().lexema == "begin" || atual().tipo == "EOF") break;
-                    continue;
+        }
+        switch (tipo) {
+            case 0:
+            case 1: {
+                TipoGerado t = (TipoGerado)ate(3);
+                escreve(var(t) + " := ");
+                expressao(t == G_REAL && chance(0.2) ? G_INT : t, cfg.profundidade);
+                return;
+            }
+            case 2: {
+                escreve("read(" + var(G_INT));
+                if (chance(0.5)) escreve(", " + var(G_REAL));
+                escreve(")");
+                return;
+            }
+            case 3: {
+                escreve("write(");
+                int n = 1 + (int)ate(3);
+                for (int k = 0; k < n; k++) {
+                    if (k) escreve(", ");
+                    if (chance(cfg.strings)) escreve("\"texto " + to_string(ate(1000)) + ": \"");
+                    else expressao((TipoGerado)ate(3), cfg.profundidade - 1);
                 }
+                escreve(")");
+                return;
             }
-            string tipo;
-            if (!this->tipo(tipo)) {
-                sincroniza();
-                if (atual().lexema == "begin" || atual().tipo == "EOF") break;
-                continue;
+            case 4:
+            case 5: {
+                escreve("if ");
+                expressao(G_BOOL, cfg.profundidade);
+                escreve(" then\n");
+                comando(nivel + 1, prof - 1, false);
+                if (chance(0.4)) {
+                    escreve("\n");
+                    indenta(nivel);
+                    escreve("else\n");
+                    comando(nivel + 1, prof - 1, false);
+                }
+                return;
             }
-            for (const auto& id : ids) {
-                declararVariavel(id, tipo, tokens[posToken > 0 ? posToken - 1 : 0].linha);
+            case 6: {
+                escreve("while ");
+                expressao(G_BOOL, cfg.profundidade);
+                escreve(" do\n");
+                comando(nivel + 1, prof - 1, false);
+                return;
             }
-            if (!casa(";")) {
-                if (atual().lexema == "begin" || atual().tipo == "Identificador") {
-    
-                    errosSintaticos.push_back("Erro sintatico linha " + to_string(tokens[posToken > 0 ? posToken - 1 : 0].linha) + ": Falta ';' no final da declaracao.\n");
-                } else {
-                    sincroniza();
+            default: {
+                escreve("begin\n");
+                int n = 1 + (int)ate(4);
+                for (int k = 0; k < n; k++) {
+                    comando(nivel + 1, prof - 1, false);
+                    escreve(k + 1 < n ? ";\n" : "\n");
                 }
+                indenta(nivel);
+                escreve("end");
+                return;
             }
         }
     }
 
-    void listaIds(vector<string>& ids) {
-        ids.push_back(atual().lexema);
-        casa("Identificador", false);
-        while (atual().lexema == ",") {
-            avanca();
-            ids.push_back(atual().lexema);
-            casa("Identificador", false);
-        }
-    }
+public:
+    GeradorProgramas(const ConfigGerador& c, ostream& saida) : cfg(c), estado(c.semente), saida(saida) {}
 
-    bool tipo(string& tipoRet) {
-        string lex = atual().lexema;
-        if (lex == "integer" || lex == "boolean" || lex == "double") {
-            tipoRet = lex;
-            avanca();
-            return true;
-        }
-        errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Esperava um tipo (integer, double, boolean), mas encontrou '" + lex + "'.\n");
-        return false;
-    }
+    void gera() {
+        int n = max(cfg.identificadores, 3);
+        const char* prefixo[3] = {"i", "d", "b"};
+        const char* nomeTipo[3] = {"integer", "double", "boolean"};
+        for (int k = 0; k < n; k++) vars[k % 3].push_back(prefixo[k % 3] + to_string(k / 3));
 
-    void listaComandos() {
-        while (atual().lexema != "end" && atual().tipo != "EOF") {
-            int linhaAnterior = atual().linha;
-            comando();
-            if (atual().lexema == "end") {
-                break;
-            }
-            if (atual().lexema != ";") {
-                if (atual().lexema != "end" && atual().tipo != "EOF") {
-    
-                    errosSintaticos.push_back("Erro sintatico linha " + to_string(linhaAnterior) + ": Falta ';' no final da instrucao.\n");
-                    sincroniza();
-                }
-            } else {
-                avanca();
+        escreve("Program Gerado" + to_string(cfg.semente) + ";\n\nvar\n");
+        for (int t = 0; t < 3; t++) {
+            for (size_t k = 0; k < vars[t].size(); k += 8) {
+                escreve("  ");
+                for (size_t j = k; j < min(vars[t].size(), k + 8); j++) escreve((j > k ? ", " : "") + vars[t][j]);
+                escreve(string(" : ") + nomeTipo[t] + ";\n");
             }
         }
+        escreve("\nbegin\n");
+        do {
+            comando(1, cfg.profundidade, chance(cfg.erros));
+            escreve(";\n");
+        } while (tamanho() < cfg.tamanho);
+        escreve("  write(\"fim\")\nend.\n");
+        descarrega();
     }
+};
 
-    void comando() {
-        string tipoToken = atual().tipo;
-        string lex = atual().lexema;
+// Pico de memoria do processo, em KB. No Windows nao ha getrusage e fica 0 (o JSON
+// do benchmark avisa)
+#ifndef _WIN32
+constexpr bool TEM_PICO_RSS = true;
 
-        if (tipoToken == "Identificador") atribuicao();
-        else if (lex == "read") leitura();
-        else if (lex == "write") escrita();
-        else if (lex == "if") se();
-        else if (lex == "while") enquanto();
-        else if (lex == "begin") blocoInicioFim();
-        else {
-            errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Comando invalido ou inesperado '" + lex + "'.\n");
-            sincroniza();
-        }
-    }
+uint64_t picoRssKb() {
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    return (uint64_t)uso.ru_maxrss;
+}
+#else
+constexpr bool TEM_PICO_RSS = false;
+
+uint64_t picoRssKb() {
+    return 0;
+}
+#endif
+
+// Mede separadamente o lexico, o sintatico e a gravacao da tabela sobre um arquivo,
+// 'repeticoes' vezes (vale a mais rapida). Grava o resultado em JSON em 'saidaJson'
+// e, com 'base', falha se alguma fase ficou mais de 'tolerancia'% mais lenta que nela
+int benchmark(const string& arquivo, int repeticoes, const string& saidaJson, const string& base, double tolerancia, ostream& rel) {
+    struct Fase {
+        const char* nome;
+        double segundos = 1e300;
+    };
+    Fase fases[3] = {{"lexico"}, {"sintatico"}, {"tabela"}};
+    uint64_t bytes = 0, tokens = 0;
+    auto agora = [] { return chrono::steady_clock::now(); };
+    auto segundos = [](chrono::steady_clock::time_point a, chrono::steady_clock::time_point b) {
+        return chrono::duration<double>(b - a).count();
+    };
 
-    void atribuicao() {
-        string id = atual().lexema;
-        int linha = atual().linha;
-        string tipoId = (tabelaSimbolos.find(id) != tabelaSimbolos.end()) ? tabelaSimbolos[id] : "desconhecido";
-        casa("Identificador", false);
-        if (!estaDeclarada(id, linha)) {
+    for (int r = 0; r < max(repeticoes, 1); r++) {
+        Fonte fonte;
+        Internador nomes;
+        auto t0 = agora();
+        auto lex = analisarLexico(arquivo, fonte, nomes);
+        auto t1 = agora();
+        if (!fonte.texto().data()) {
+            rel << "Erro: Nao abriu arquivo '" << arquivo << "'\n";
+            return 1;
         }
-        if (atual().lexema == ":=") {
-            avanca();
-            string tipoExp = tipoExpressao();
-            expressao();
-            if (tipoId != "desconhecido" && tipoExp != "desconhecido") {
-                if (tipoId == "integer" && tipoExp != "integer") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Atribuicao de tipo '" + tipoExp + "' para variavel '" + id + "' do tipo integer.\n");
-                } else if (tipoId == "double" && tipoExp != "integer" && tipoExp != "double") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Atribuicao de tipo '" + tipoExp + "' para variavel '" + id + "' do tipo double.\n");
-                } else if (tipoId == "boolean" && tipoExp != "boolean") {
-                    errosSemanticos.push_back("Erro semantico linha " + to_string(linha) + ": Atribuicao de tipo '" + tipoExp + "' para variavel '" + id + "' do tipo boolean.\n");
-                }
-            }
-        } else if (atual().lexema == "=") {
-            int linhaDoErro = atual().linha; 
-            avanca();
-            errosSintaticos.push_back("Erro sintatico linha " + to_string(linhaDoErro) + ": Operador de atribuicao invalido '='. Use ':='.\n");
-            expressao();
-        } else {
-            sincroniza();
+        bytes = fonte.texto().size();
+        tokens = lex.first.size();
+
+        {
+            Arvore arvore;
+            FluxoTokens fluxo(lex.first);
+            Sintatico sint(fluxo, fonte, nomes, arvore);
+            sint.analisar();
+            auto t2 = agora();
+            fases[1].segundos = min(fases[1].segundos, segundos(t1, t2));
         }
-    }
 
-    void leitura() {
-        casa("read");
-        casa("(");
-        vector<string> ids;
-        listaIds(ids);
-        for (const auto& id : ids) {
-            estaDeclarada(id, tokens[posToken > 0 ? posToken - 1 : 0].linha);
+        string arqTabela = arquivo + ".bench.tabela.txt";
+        auto t3 = agora();
+        {
+            EscritorTabela tabela;
+            if (!tabela.abre(arqTabela)) {
+                rel << "Erro: Nao abriu arquivo de saida '" << arqTabela << "'\n";
+                return 1;
+            }
+            tabela.cabecalho();
+            for (const Simbolo& s : lex.first) tabela.linha(fonte, s);
         }
-        casa(")");
+        auto t4 = agora();
+        remove(arqTabela.c_str());
+        fases[0].segundos = min(fases[0].segundos, segundos(t0, t1));
+        fases[2].segundos = min(fases[2].segundos, segundos(t3, t4));
     }
 
-    void escrita() {
-        casa("write");
-        casa("(");
-        listaExp();
-        casa(")");
+    ostringstream json;
+    json << "{\n  \"versao\": " << textoJson(VERSAO_COMPILADOR) << ",\n  \"arquivo\": " << textoJson(arquivo)
+         << ",\n  \"bytes\": " << bytes << ",\n  \"tokens\": " << tokens << ",\n  \"repeticoes\": " << max(repeticoes, 1)
+         << ",\n  \"pico_rss_kb\": " << picoRssKb()
+         << (TEM_PICO_RSS ? "" : ",\n  \"nota\": \"pico de memoria indisponivel nesta plataforma\"") << ",\n  \"fases\": {\n";
+    rel << left << setw(12) << "Fase" << setw(12) << "segundos" << setw(12) << "MB/s" << "tokens/s\n";
+    for (int k = 0; k < 3; k++) {
+        double s = max(fases[k].segundos, 1e-9);
+        double mbs = (double)bytes / (1 << 20) / s, toks = (double)tokens / s;
+        json << "    " << textoJson(fases[k].nome) << ": {\"segundos\": " << setprecision(6) << s << ", \"mb_s\": " << mbs
+             << ", \"tokens_s\": " << toks << "}" << (k < 2 ? ",\n" : "\n");
+        rel << left << setw(12) << fases[k].nome << setw(12) << setprecision(4) << s << setw(12) << mbs << toks << "\n";
     }
+    json << "  }\n}\n";
+    rel << "Arquivo: " << bytes << " bytes, " << tokens << " tokens; pico de memoria ";
+    if (TEM_PICO_RSS) rel << picoRssKb() << " KB\n";
+    else rel << "indisponivel\n";
 
-    void se() {
-        casa("if");
-        string tipoExp = tipoExpressao();
-        expressao();
-        if (tipoExp != "boolean" && tipoExp != "desconhecido") {
-            errosSemanticos.push_back("Erro semantico linha " + to_string(atual().linha) + ": Expressao do 'if' deve ser booleana, encontrou " + tipoExp + ".\n");
-        }
-        if (!casa("then")) {
-        }
-        comando();
-        if (atual().lexema == "else") {
-            avanca();
-            comando();
+    if (!saidaJson.empty()) {
+        ofstream arq(saidaJson);
+        arq << json.str();
+        if (!arq) {
+            cerr << "Erro: Nao abriu arquivo de saida '" << saidaJson << "'\n";
+            return 1;
         }
     }
 
-    void enquanto() {
-        casa("while");
-        string tipoExp = tipoExpressao();
-        expressao();
-        if (tipoExp != "boolean" && tipoExp != "desconhecido") {
-            errosSemanticos.push_back("Erro semantico linha " + to_string(atual().linha) + ": Expressao do 'while' deve ser booleana, encontrou " + tipoExp + ".\n");
-        }
-        if (!casa("do")) {
-            sincroniza();
-        } else {
-            comando();
+    if (base.empty()) return 0;
+    ifstream arqBase(base);
+    if (!arqBase.is_open()) {
+        cerr << "Erro: Nao abriu arquivo '" << base << "'\n";
+        return 1;
+    }
+    string textoBase((istreambuf_iterator<char>(arqBase)), istreambuf_iterator<char>());
+    bool regrediu = false;
+    for (int k = 0; k < 3; k++) {
+        size_t p = textoBase.find(textoJson(fases[k].nome));
+        if (p == string::npos || (p = textoBase.find("\"mb_s\":", p)) == string::npos) continue;
+        double antes = strtod(textoBase.c_str() + p + 7, nullptr);
+        double agoraMbs = (double)bytes / (1 << 20) / max(fases[k].segundos, 1e-9);
+        if (agoraMbs < antes * (1 - tolerancia / 100)) {
+            rel << "Regressao na fase '" << fases[k].nome << "': " << agoraMbs << " MB/s, base " << antes << " MB/s\n";
+            regrediu = true;
         }
     }
+    return regrediu ? 1 : 0;
+}
+
+// Fuzzing do front end. Os alvos analisam a entrada na memoria e servem ao libFuzzer:
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined -DFUZZ=1 main.cpp   (so o lexico)
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined -DFUZZ=2 main.cpp   (lexico, sintatico e semantico)
+//   ./a.out -timeout=30 corpus/ fuzz/   (fuzz/ e o corpus de sementes do repositorio;
+//                                        --fuzz-corpus DIR grava mais, do gerador)
+// e ao modo --fuzz, que dispensa o clang. Uma entrada que passa do orcamento de
+// tempo, proporcional ao tamanho dela, aborta como um crash: assim um caminho
+// superlinear aparece como falha
+enum AlvoFuzz { FUZZ_LEXICO = 1, FUZZ_COMPLETO = 2 };
 
-    void blocoInicioFim() {
-        casa("begin");
-        listaComandos();
-        casa("end");
+constexpr double ORCAMENTO_BASE_MS = 100;       // partida, alocacoes e ruido da maquina
+constexpr double ORCAMENTO_NS_POR_BYTE = 5000;  // centenas de vezes o custo linear, ja com sanitizers
+constexpr size_t TAM_MAX_FUZZ = 1 << 20;
+
+double orcamentoFuzz(size_t n) {
+    return ORCAMENTO_BASE_MS + (double)n * ORCAMENTO_NS_POR_BYTE / 1e6;
+}
+
+// Lexico sozinho no nivel escalar e em cada nivel de SIMD que a CPU suporta: todos
+// tem de dar os mesmos tokens e os mesmos erros. Um nivel sem suporte cairia num
+// nivel abaixo, ja comparado, e e pulado (niveisFuzzLexico diz quais rodam)
+vector<NivelSimd> niveisFuzzLexico() {
+    vector<NivelSimd> niveis;
+    for (NivelSimd nivel : {SIMD_SSE2, SIMD_AVX2}) {
+        if (escolheVarredura(nivel).nivel == nivel) niveis.push_back(nivel);
     }
+    return niveis;
+}
 
-    void listaExp() {
-        expressao();
-        while (atual().lexema == ",") {
-            avanca();
-            expressao();
+void fuzzLexico(string_view texto) {
+    static const vector<NivelSimd> niveis = niveisFuzzLexico();
+    auto analisa = [&](NivelSimd nivel, vector<Simbolo>& tokens, vector<string>& erros) {
+        Varredura anterior = varredura;
+        varredura = escolheVarredura(nivel);
+        Fonte fonte;
+        fonte.carrega(string(texto));
+        Internador nomes;
+        Lexico lexico(fonte, nomes);
+        Simbolo simb;
+        while (lexico.proximo(simb)) tokens.push_back(simb);
+        for (size_t i = 0; i < lexico.getErros().tamanho(); i++) erros.push_back(lexico.getErros().mensagem(i));
+        varredura = anterior;
+    };
+    vector<Simbolo> escalar;
+    vector<string> errosEscalar;
+    analisa(SIMD_ESCALAR, escalar, errosEscalar);
+    for (NivelSimd nivel : niveis) {
+        vector<Simbolo> simd;
+        vector<string> errosSimd;
+        analisa(nivel, simd, errosSimd);
+        bool iguais = escalar.size() == simd.size() && errosEscalar == errosSimd;
+        for (size_t k = 0; iguais && k < escalar.size(); k++) {
+            const Simbolo& a = escalar[k];
+            const Simbolo& b = simd[k];
+            iguais = a.inicio == b.inicio && a.linha == b.linha && a.tamanho == b.tamanho && a.coluna == b.coluna &&
+                     a.id == b.id && a.tipo == b.tipo && a.sub == b.sub;
+        }
+        if (!iguais) {
+            fprintf(stderr, "Lexico escalar e %s discordam\n", nomeSimd[nivel]);
+            abort();
         }
     }
+}
 
-    void expressao() {
-        expressaoSimples();
-        while (atual().lexema == "=" || atual().lexema == "<>" || atual().lexema == "<" ||
-               atual().lexema == ">" || atual().lexema == "<=" || atual().lexema == ">=") {
-            avanca();
-            expressaoSimples();
-        }
+// Front end inteiro como em compilaArquivo; sem erros, gera tambem o intermediario
+void fuzzCompleto(string_view texto) {
+    Fonte fonte;
+    fonte.carrega(string(texto));
+    Internador nomes;
+    Arvore arvore;
+    Lexico lexico(fonte, nomes);
+    FluxoTokens fluxo(lexico);
+    Sintatico sint(fluxo, fonte, nomes, arvore);
+    sint.analisar();
+    fluxo.esgota();
+    ostringstream rel;
+    if (relataErros(rel, lexico.getErros(), sint.getErrosSintaticos(), sint.getErrosSemanticos())) {
+        CodigoIntermediario codigo;
+        GeradorIntermediario(arvore, fonte, codigo).gerar();
     }
+}
 
-    void expressaoSimples() {
-        termo();
-        while (atual().lexema == "+" || atual().lexema == "-" || atual().lexema == "or") {
-            avanca();
-            termo();
-        }
+// Roda um alvo numa entrada; passar do orcamento aborta
+void rodaFuzz(int alvo, const uint8_t* dados, size_t n) {
+    auto inicio = chrono::steady_clock::now();
+    string_view texto((const char*)dados, n);
+    if (alvo == FUZZ_LEXICO) fuzzLexico(texto);
+    else fuzzCompleto(texto);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - inicio).count();
+    if (ms > orcamentoFuzz(n)) {
+        fprintf(stderr, "Entrada de %zu bytes levou %.1f ms; o orcamento era %.1f ms\n", n, ms, orcamentoFuzz(n));
+        abort();
     }
+}
 
-    void termo() {
-        fator();
-        while (atual().lexema == "*" || atual().lexema == "/" || atual().lexema == "and" ||
-               atual().lexema == "div" || atual().lexema == "mod") {
-            avanca();
-            fator();
+#ifdef FUZZ
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* dados, size_t n) {
+    rodaFuzz(FUZZ, dados, n);
+    return 0;
+}
+#endif
+
+// Corpus inicial: o codigo.txt de exemplo, se houver, e programas do gerador com
+// tamanhos, aninhamento e taxas de erro variados
+vector<string> corpusFuzz(size_t quantos) {
+    vector<string> corpus;
+    Fonte exemplo;
+    if (exemplo.abrir("codigo.txt")) corpus.emplace_back(exemplo.texto());
+    for (size_t k = 0; k < quantos; k++) {
+        ConfigGerador cfg;
+        cfg.semente = k + 1;
+        cfg.tamanho = 128u << (k % 10);
+        cfg.profundidade = 2 + (int)(k % 4);
+        cfg.comentarios = 0.1;
+        cfg.erros = (double)(k % 4) * 0.1;
+        ostringstream saida;
+        GeradorProgramas(cfg, saida).gera();
+        corpus.push_back(saida.str());
+    }
+    return corpus;
+}
+
+// Grava o corpus inicial em 'dir', um arquivo por programa
+int gravaCorpusFuzz(const string& dir, ostream& rel) {
+    error_code ec;
+    filesystem::create_directories(dir, ec);
+    vector<string> corpus = corpusFuzz(64);
+    for (size_t k = 0; k < corpus.size(); k++) {
+        string caminho = dir + "/semente-" + to_string(k) + ".pas";
+        ofstream arq(caminho, ios::binary);
+        arq << corpus[k];
+        if (!arq) {
+            cerr << "Erro: Nao abriu arquivo de saida '" << caminho << "'\n";
+            return 1;
         }
     }
+    rel << corpus.size() << " programas gravados em '" << dir << "'.\n";
+    return 0;
+}
 
-    void fator() {
-        string t = atual().tipo;
-        string lex = atual().lexema;
-        int linha = atual().linha;
+// Entrada em analise no modo --fuzz, para o tratador de sinais salvar se o
+// processo cair ou travar
+const char* entradaFuzz = nullptr;
+size_t tamEntradaFuzz = 0;
+constexpr const char* ARQUIVO_FALHA_FUZZ = "fuzz-falha.pas";
 
-        if (t == "Identificador") {
-            estaDeclarada(lex, linha);
-            avanca();
-        } else if (t == "Numero inteiro" || t == "Numero real" || t == "String literal") {
-            avanca();
-        } else if (lex == "true" || lex == "false") {
-            avanca();
-        } else if (lex == "(") {
-            avanca();
-            expressao();
-            casa(")");
-        } else if (lex == "not") {
-            avanca();
-            fator();
-        } else if (t == "erro_lexico") {
-            avanca();
-        } else {
-            errosSintaticos.push_back("Erro sintatico linha " + to_string(atual().linha) + ": Token inesperado '" + lex + "' na expressao.\n");
-            sincroniza();
+#ifndef _WIN32
+// So chamadas seguras dentro de um tratador de sinal. Um alarme vira SIGABRT, como
+// o aborto de rodaFuzz quando a entrada termina mas passa do orcamento
+extern "C" void salvaEntradaFuzz(int sinal) {
+    auto escreve = [](const char* msg) {
+        if (write(STDERR_FILENO, msg, strlen(msg)) < 0) {}
+    };
+    if (sinal == SIGALRM) escreve("Entrada passou do dobro do orcamento de tempo sem terminar\n");
+    int fd = entradaFuzz ? open(ARQUIVO_FALHA_FUZZ, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (fd >= 0) {
+        for (size_t feito = 0; feito < tamEntradaFuzz;) {
+            ssize_t n = write(fd, entradaFuzz + feito, tamEntradaFuzz - feito);
+            if (n <= 0) break;
+            feito += (size_t)n;
         }
+        close(fd);
+        escreve("Falha no fuzzing; entrada salva em 'fuzz-falha.pas'\n");
     }
+    signal(sinal, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+    raise(sinal == SIGALRM ? SIGABRT : sinal);
+}
+#endif
 
-public:
-    Sintatico(const vector<Simbolo>& toks) : posToken(0), tokens(toks) {}
-
-    void analisar() {
-        if (tokens.empty()) {
-            errosSintaticos.push_back("Erro sintatico: Nao ha tokens para analisar.\n");
-            return;
+// Fuzzing sem o libFuzzer: muta o corpus (de 'dir', ou o inicial) e roda o alvo em
+// cada mutacao. As mutacoes trocam, inserem, apagam e repetem trechos; repetir um
+// trecho milhares de vezes e o que expoe aninhamento fundo e custo superlinear.
+// Na primeira falha a entrada fica em fuzz-falha.pas e o processo cai
+int fuzz(int alvo, const string& dir, uint64_t execucoes, uint64_t semente, ostream& rel) {
+    vector<string> corpus;
+    if (!dir.empty()) {
+        error_code ec;
+        for (filesystem::directory_iterator it(dir, ec), fim; !ec && it != fim; it.increment(ec)) {
+            Fonte f;
+            if (it->is_regular_file() && f.abrir(it->path().string())) corpus.emplace_back(f.texto());
         }
-        prog();
     }
+    if (corpus.empty()) corpus = corpusFuzz(64);
 
-    vector<string> getErrosSintaticos() {
-        return errosSintaticos;
+    vector<string_view> dicionario = {"(*", "*)", "\"", "\n", " ", "1.5e", "99999999999999999999", "x", "a1"};
+    for (int s = PR_PROGRAM; s < NUM_SUB; s++) dicionario.push_back(textoSub[s]);
+    uint64_t estado = semente * 0x9E3779B97F4A7C15ull + 1;
+    auto ate = [&](uint64_t n) {
+        estado ^= estado << 13;
+        estado ^= estado >> 7;
+        estado ^= estado << 17;
+        return n ? estado % n : 0;
+    };
+
+#ifndef _WIN32
+    for (int sinal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGALRM}) signal(sinal, salvaEntradaFuzz);
+#endif
+    if (alvo == FUZZ_LEXICO) {
+        vector<NivelSimd> niveis = niveisFuzzLexico();
+        if (niveis.empty()) rel << "Nenhum nivel de SIMD nesta CPU; o lexico roda so no escalar, sem comparacao.\n";
+        else {
+            rel << "Lexico escalar comparado com:";
+            for (NivelSimd nivel : niveis) rel << ' ' << nomeSimd[nivel];
+            rel << ".\n";
+        }
     }
-    vector<string> getErrosSemanticos() {
-        return errosSemanticos;
+    uint64_t bytes = 0;
+    size_t maior = 0;
+    string entrada;
+    for (uint64_t k = 0; k < execucoes; k++) {
+        entrada = corpus[ate(corpus.size())];
+        for (uint64_t m = 1 + ate(6); m > 0; m--) {
+            size_t pos = ate(entrada.size() + 1);
+            size_t n = min<size_t>(entrada.size() - pos, 1 + ate(32));
+            switch (ate(6)) {
+                case 0: if (pos < entrada.size()) entrada[pos] = (char)ate(256); break;
+                case 1: entrada.insert(pos, dicionario[ate(dicionario.size())]); break;
+                case 2: entrada.erase(pos, n); break;
+                case 3: entrada.insert(pos, entrada.substr(pos, n)); break;
+                case 4: {
+                    const string& outra = corpus[ate(corpus.size())];
+                    entrada.replace(pos, string::npos, outra, ate(outra.size() + 1), string::npos);
+                    break;
+                }
+                default: {
+                    string trecho = n ? entrada.substr(pos, n) : string(dicionario[ate(dicionario.size())]);
+                    size_t vezes = min<size_t>(1ull << ate(15), (TAM_MAX_FUZZ - min(entrada.size(), TAM_MAX_FUZZ)) / trecho.size());
+                    string repetido;
+                    repetido.reserve(vezes * trecho.size());
+                    for (size_t r = 0; r < vezes; r++) repetido += trecho;
+                    entrada.insert(pos, repetido);
+                    break;
+                }
+            }
+        }
+        if (entrada.size() > TAM_MAX_FUZZ) entrada.resize(TAM_MAX_FUZZ);
+        entradaFuzz = entrada.data();
+        tamEntradaFuzz = entrada.size();
+#ifndef _WIN32
+        // Uma entrada que nem termina tambem estoura: o alarme e o dobro do orcamento
+        itimerval alarme{};
+        uint64_t us = (uint64_t)(2000 * orcamentoFuzz(entrada.size()));
+        alarme.it_value.tv_sec = (time_t)(us / 1000000);
+        alarme.it_value.tv_usec = (suseconds_t)(us % 1000000);
+        setitimer(ITIMER_REAL, &alarme, nullptr);
+#endif
+        rodaFuzz(alvo, (const uint8_t*)entrada.data(), entrada.size());
+#ifndef _WIN32
+        itimerval desliga{};
+        setitimer(ITIMER_REAL, &desliga, nullptr);
+#endif
+        entradaFuzz = nullptr;
+        tamEntradaFuzz = 0;
+        bytes += entrada.size();
+        maior = max(maior, entrada.size());
+        if ((k + 1) % 10000 == 0) rel << k + 1 << " execucoes..." << endl;
     }
-};
+    rel << execucoes << " execucoes sem falhas (" << bytes / (1 << 20) << " MB, maior entrada com " << maior << " bytes).\n";
+    return 0;
+}
 
-int main() {
-    string arquivo = "codigo.txt";
-    string saida = "tabela.txt";
+#ifndef FUZZ
+int main(int argc, char* argv[]) {
+    Opcoes op;
+    vector<string> entradas;
+    unsigned numThreads = max(thread::hardware_concurrency(), 1u);
+    bool incremental = false, servidor = false;
+    string dirCache;
+    uint64_t limiteCache = 1024;
+    string gerar, bench, saidaJson, baseBench, saidaRastro, lerTokens, lerUnidade, nivelSimd;
+    string alvoFuzz, dirCorpus, gravaCorpus;
+    uint64_t execucoes = 100000;
+    ConfigGerador cfg;
+    int repeticoes = 3;
+    double tolerancia = 10;
 
-    auto resultado = analisarLexico(arquivo);
-    vector<Simbolo> tabela = resultado.first;
-    vector<string> errosLex = resultado.second;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--sem-tabela") op.gravaTabela = false;
+        else if (arg == "--sem-intermediario") op.gravaCodigo = false;
+        else if (arg == "--estatisticas" || arg == "--stats") op.mostraEstatisticas = true;
+        else if (arg == "--trace" && i + 1 < argc) saidaRastro = argv[++i];
+        else if (arg == "--executar") op.executar = true;
+        else if (arg == "--max-erros" && i + 1 < argc) op.limiteErros.maximo = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--sem-repetidos") op.limiteErros.semRepetidos = true;
+        else if (arg == "--max-profundidade" && i + 1 < argc) op.maxProfundidade = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--diagnosticos-json") op.diagnosticosJson = true;
+        else if (arg == "--tokens-bin") op.gravaTokens = true;
+        else if (arg == "--unidade") op.gravaUnidade = true;
+        else if (arg == "--ler-unidade" && i + 1 < argc) lerUnidade = argv[++i];
+        else if (arg == "--ler-tokens" && i + 1 < argc) lerTokens = argv[++i];
+        else if (arg == "--asm") op.geraAssembly = true;
+        else if (arg == "--incremental") incremental = true;
+        else if (arg == "--servidor") servidor = true;
+        else if (arg == "--cache" && i + 1 < argc) dirCache = argv[++i];
+        else if (arg == "--cache-max" && i + 1 < argc) limiteCache = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--gerar" && i + 1 < argc) gerar = argv[++i];
+        else if (arg == "--tamanho" && i + 1 < argc) cfg.tamanho = leTamanho(argv[++i]);
+        else if (arg == "--semente" && i + 1 < argc) cfg.semente = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--profundidade" && i + 1 < argc) cfg.profundidade = max(atoi(argv[++i]), 0);
+        else if (arg == "--identificadores" && i + 1 < argc) cfg.identificadores = atoi(argv[++i]);
+        else if (arg == "--comentarios" && i + 1 < argc) cfg.comentarios = atof(argv[++i]);
+        else if (arg == "--strings" && i + 1 < argc) cfg.strings = atof(argv[++i]);
+        else if (arg == "--erros" && i + 1 < argc) cfg.erros = atof(argv[++i]);
+        else if (arg == "--benchmark" && i + 1 < argc) bench = argv[++i];
+        else if (arg == "--repeticoes" && i + 1 < argc) repeticoes = atoi(argv[++i]);
+        else if (arg == "--json" && i + 1 < argc) saidaJson = argv[++i];
+        else if (arg == "--comparar" && i + 1 < argc) baseBench = argv[++i];
+        else if (arg == "--tolerancia" && i + 1 < argc) tolerancia = atof(argv[++i]);
+        else if (arg == "--fuzz" && i + 1 < argc) alvoFuzz = argv[++i];
+        else if (arg == "--corpus" && i + 1 < argc) dirCorpus = argv[++i];
+        else if (arg == "--execucoes" && i + 1 < argc) execucoes = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--fuzz-corpus" && i + 1 < argc) gravaCorpus = argv[++i];
+        else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '2') op.nivelOtimizacao = arg[2] - '0';
+        else if (arg == "--simd" && i + 1 < argc) nivelSimd = argv[++i];
+        else if (arg == "-j" && i + 1 < argc) numThreads = (unsigned)max(atoi(argv[++i]), 1);
+        else if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'j') numThreads = (unsigned)max(atoi(arg.c_str() + 2), 1);
+        else entradas.push_back(arg);
+    }
 
-    ofstream arqSaida(saida);
-    if (!arqSaida.is_open()) {
-        cerr << "Erro: Nao abriu arquivo de saida '" << saida << "'\n";
+    if (op.maxProfundidade > PROFUNDIDADE_MAXIMA) {
+        cerr << "Erro: --max-profundidade passa do maximo de " << PROFUNDIDADE_MAXIMA << " que a pilha nativa suporta\n";
         return 1;
     }
 
-    arqSaida << left << setw(20) << "Lexema" << setw(25) << "Tipo" << setw(10) << "Linha" << "\n";
-    arqSaida << string(55, '-') << "\n";
-    for (const auto& simb : tabela) {
-        arqSaida << left << setw(20) << simb.lexema << setw(25) << simb.tipo << setw(10) << simb.linha << "\n";
+    // '--simd escalar|sse2|avx2' limita a varredura do lexico (o padrao e o melhor da CPU)
+    if (!nivelSimd.empty()) {
+        size_t k = 0;
+        while (k <= SIMD_AVX2 && nivelSimd != nomeSimd[k]) k++;
+        if (k > SIMD_AVX2) {
+            cerr << "Erro: Nivel de --simd desconhecido '" << nivelSimd << "'\n";
+            return 1;
+        }
+        varredura = escolheVarredura((NivelSimd)k);
+    }
+
+    // Gerador de programas: '--gerar arquivo' com '--tamanho 10M', '--semente', ...
+    if (!gerar.empty()) {
+        ofstream saida(gerar, ios::binary);
+        if (!saida.is_open()) {
+            cerr << "Erro: Nao abriu arquivo de saida '" << gerar << "'\n";
+            return 1;
+        }
+        GeradorProgramas(cfg, saida).gera();
+        return saida ? 0 : 1;
+    }
+    // '--fuzz lexico|completo' com '--corpus dir', '--execucoes N' e '--semente'
+    if (!gravaCorpus.empty()) return gravaCorpusFuzz(gravaCorpus, cout);
+    if (!alvoFuzz.empty()) {
+        if (alvoFuzz != "lexico" && alvoFuzz != "completo") {
+            cerr << "Erro: Alvo de --fuzz desconhecido '" << alvoFuzz << "'\n";
+            return 1;
+        }
+        return fuzz(alvoFuzz == "lexico" ? FUZZ_LEXICO : FUZZ_COMPLETO, dirCorpus, execucoes, cfg.semente, cout);
+    }
+    if (servidor) {
+        // Sem sincronizar com stdio, cin le em blocos em vez de um getc por caractere
+        ios::sync_with_stdio(false);
+        return Servidor(cin, cout).roda(numThreads);
     }
-    arqSaida.close();
+    if (!lerTokens.empty()) return leTokens(lerTokens, Saidas().tabela, cout);
+    if (!lerUnidade.empty()) return leUnidade(lerUnidade, cout);
+    if (!bench.empty()) return benchmark(bench, repeticoes, saidaJson, baseBench, tolerancia, cout);
 
-    cout << "Analise lexica terminada. Tabela de simbolos salva em '" << saida << "'.\n";
+    // Diretorios entram com todos os .pas de dentro, em ordem de nome
+    vector<string> arquivos;
+    bool lote = entradas.size() > 1;
+    for (const string& e : entradas) {
+        error_code ec;
+        if (!filesystem::is_directory(e, ec)) {
+            arquivos.push_back(e);
+            continue;
+        }
+        lote = true;
+        vector<string> achados;
+        for (filesystem::recursive_directory_iterator it(e, ec), fim; !ec && it != fim; it.increment(ec)) {
+            if (it->is_regular_file(ec) && it->path().extension() == ".pas") achados.push_back(it->path().string());
+        }
+        sort(achados.begin(), achados.end());
+        arquivos.insert(arquivos.end(), achados.begin(), achados.end());
+    }
 
-    if (!errosLex.empty()) {
-        cout << "\n- Erros Lexicos Encontrados -\n";
-        for (const auto& e : errosLex) cout << e;
+    if (incremental) {
+        if (lote) {
+            cerr << "Erro: --incremental so pode ser usado com um unico arquivo\n";
+            return 1;
+        }
+        return sessaoIncremental(arquivos.empty() ? "codigo.txt" : arquivos[0], cin, cout);
     }
-    
-    if (!errosLex.empty() && errosLex[0].find("Nao abriu arquivo") != string::npos) {
+    if (lote && op.executar) {
+        cerr << "Erro: --executar so pode ser usado com um unico arquivo\n";
         return 1;
     }
 
-    cout << "\n- Iniciando Analise Sintatica e Semantica -\n";
-    Sintatico sint(tabela);
-    sint.analisar();
+    // Cache em '--cache DIR', limitado a '--cache-max' MB
+    unique_ptr<CacheCompilacao> cache;
+    if (!dirCache.empty()) cache = make_unique<CacheCompilacao>(dirCache, limiteCache << 20);
 
-    vector<string> errosSint = sint.getErrosSintaticos();
-    vector<string> errosSem = sint.getErrosSemanticos();
+    // '--trace arquivo.json': eventos das fases de todas as compilacoes
+    Rastro rastro;
+    if (!saidaRastro.empty()) op.rastro = &rastro;
 
-    if (!errosSint.empty()) {
-        cout << "\n- Erros Sintaticos Encontrados -\n";
-        for (const auto& e : errosSint) cout << e;
+    // Em todos os modos (um arquivo, lote, --incremental) o retorno e 1 se algum
+    // fonte tem erros, para scripts e CI; o resto do relatorio sai igual
+    int codigo;
+    if (!lote) {
+        bool semErros;
+        op.threadsLexico = numThreads;
+        codigo = compilaComCache(arquivos.empty() ? "codigo.txt" : arquivos[0], Saidas(), op, cache.get(), cout, semErros);
+        if (!semErros) codigo = 1;
+    } else {
+        codigo = compilaLote(arquivos, op, numThreads, cache.get(), cout);
     }
-
-    if (!errosSem.empty()) {
-        cout << "\n- Erros Semanticos Encontrados -\n";
-        for (const auto& e : errosSem) cout << e;
+    if (cache) {
+        cache->limpa();
+        cache->relata(cout);
     }
-
-    if (errosLex.empty() && errosSint.empty() && errosSem.empty()) {
-        cout << "\nAnalises lexica, sintatica e semantica concluidas sem erros.\n";
+    if (op.rastro && !rastro.grava(saidaRastro)) {
+        cerr << "Erro: Nao abriu arquivo de saida '" << saidaRastro << "'\n";
+        codigo = 1;
     }
-
-    return 0;
-}
\ No newline at end of file
+    return codigo;
+}
+#endif